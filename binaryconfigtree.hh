@@ -0,0 +1,777 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef BINARYCONFIGTREE_HH
+#define BINARYCONFIGTREE_HH
+
+/** \file
+ * \brief Memory-mappable binary format of a ConfigTree
+ */
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "configtree.hh"
+#include "mappedfile.hh"
+#include "stringview.hh"
+
+/** \brief Read-only ConfigTree stored in the binary format
+ *
+ * write() serializes a ConfigTree into a compact binary file, which is
+ * later read in place: loading maps the file and checks its header,
+ * lookups binary search the sorted key tables of the file. Nothing is
+ * parsed or copied, and the const lookup methods of ConfigTree are
+ * available with the same semantics. Values stay strings; numbers can
+ * additionally be stored pre-parsed, then get<T>() of integral types and
+ * double does not parse them again.
+ *
+ * The file consists of a fixed header followed by tables, each aligned
+ * to 8 bytes:
+ * - nodes: one per (sub)tree, the ranges of its values and subtrees,
+ * - values: key, value and pre-parsed number, in order of appearance,
+ * - value order: per node the indices of its values sorted by key,
+ * - subs: key and node of each subtree, in order of appearance,
+ * - sub order: per node the indices of its subtrees sorted by key,
+ * - strings: offset and size of each distinct string,
+ * - the characters of the strings, each terminated by '\\0'.
+ *
+ * The header holds a format version, the byte order of the writer, the
+ * file size and a checksum of everything behind the header. Files of
+ * another version or byte order are rejected.
+ */
+class BinaryConfigTree
+{
+public:
+
+  /** \brief version of the format written by write() */
+  static const std::uint32_t version = 1;
+
+  /** \brief view of the binary tree in the file with the given name
+   *
+   * \param file   filename
+   * \param verify whether to check the checksum and all table indices.
+   *               Only skip this for files from a trusted source.
+   * \throw std::ifstream::failure if the file cannot be opened
+   * \throw std::range_error if the file is not a valid binary tree
+   */
+  explicit BinaryConfigTree(const std::string& file, bool verify = true)
+    : file_(std::make_shared<MappedFile>(file)), node_(0), prefix_("")
+  {
+    open(file_->data(), file_->size(), "file '" + file + "'", verify);
+  }
+
+  /** \brief view of the binary tree in a buffer
+   *
+   * The buffer must outlive the view and all substructures taken from it.
+   *
+   * \throw std::range_error if the buffer is not a valid binary tree
+   */
+  BinaryConfigTree(const char* data, std::size_t size, bool verify = true)
+    : node_(0), prefix_("")
+  {
+    open(data, size, "buffer", verify);
+  }
+
+  /** \brief test for key, see ConfigTree::hasKey() */
+  bool hasKey(const std::string& key) const
+  {
+    std::string::size_type dot = key.find(".");
+    if (dot not_eq std::string::npos)
+    {
+      std::string prefix = key.substr(0,dot);
+      std::uint32_t s = findSub(prefix);
+      if (s == none)
+        return false;
+      if (findValue(prefix) not_eq none)
+        conflict(prefix);
+      return child(prefix, s).hasKey(key.substr(dot+1));
+    }
+    if (findValue(key) == none)
+      return false;
+    if (findSub(key) not_eq none)
+      conflict(key);
+    return true;
+  }
+
+  /** \brief test for substructure, see ConfigTree::hasSub() */
+  bool hasSub(const std::string& key) const
+  {
+    std::string::size_type dot = key.find(".");
+    if (dot not_eq std::string::npos)
+    {
+      std::string prefix = key.substr(0,dot);
+      std::uint32_t s = findSub(prefix);
+      if (s == none)
+        return false;
+      if (findValue(prefix) not_eq none)
+        conflict(prefix);
+      return child(prefix, s).hasSub(key.substr(dot+1));
+    }
+    if (findSub(key) == none)
+      return false;
+    if (findValue(key) not_eq none)
+      conflict(key);
+    return true;
+  }
+
+  /** \brief get value for key, see ConfigTree::operator[]()
+   *
+   * \return view of the value in the file
+   * \throw std::range_error if key is not found
+   */
+  StringView operator[] (const std::string& key) const
+  {
+    std::string::size_type dot = key.find(".");
+    if (dot not_eq std::string::npos)
+      return sub(key.substr(0,dot))[key.substr(dot+1)];
+    std::uint32_t v = findValue(key);
+    if (v == none)
+    {
+      std::ostringstream message;
+      message << "Key '" << key << "' not found in ParameterTree (prefix " + prefix_ + ")";
+      throw std::range_error(message.str());
+    }
+    return string(valueEntry(v).value);
+  }
+
+  /** \brief get substructure by name, see ConfigTree::sub()
+   *
+   * A missing substructure is empty, unless fail_if_missing is set.
+   */
+  BinaryConfigTree sub(const std::string& key, bool fail_if_missing = false) const
+  {
+    std::string::size_type dot = key.find(".");
+    if (dot not_eq std::string::npos)
+      return sub(key.substr(0,dot)).sub(key.substr(dot+1), fail_if_missing);
+    if (findValue(key) not_eq none)
+      conflict(key);
+    std::uint32_t s = findSub(key);
+    if (s == none and fail_if_missing)
+    {
+      std::ostringstream message;
+      message << "SubTree '" << key << "' not found in ParameterTree (prefix " + prefix_ + ")";
+      throw std::range_error(message.str());
+    }
+    return child(key, s);
+  }
+
+  /** \brief get value as string, see ConfigTree::get() */
+  std::string get(const std::string& key, const std::string& defaultValue) const
+  {
+    if (hasKey(key))
+      return (*this)[key].str();
+    else
+      return defaultValue;
+  }
+
+  /** \brief get value as string, see ConfigTree::get() */
+  std::string get(const std::string& key, const char* defaultValue) const
+  {
+    if (hasKey(key))
+      return (*this)[key].str();
+    else
+      return defaultValue;
+  }
+
+  /** \brief get value converted to a certain type, see ConfigTree::get() */
+  template<typename T>
+  T get(const std::string& key, const T& defaultValue) const
+  {
+    if (hasKey(key))
+      return get<T>(key);
+    else
+      return defaultValue;
+  }
+
+  /** \brief get value converted to a certain type, see ConfigTree::get()
+   *
+   * \throw std::range_error if key does not exist or cannot be converted
+   */
+  template <class T>
+  T get(const std::string& key) const
+  {
+    if (not hasKey(key))
+    {
+      std::ostringstream message;
+      message << "Key '" << key << "' not found in ParameterTree (prefix " + prefix_ + ")";
+      throw std::range_error(message.str());
+    }
+    const ValueEntry entry = valueEntry(key);
+    T val;
+    if (Typed<T>::get(entry, val))
+      return val;
+    const std::string value = string(entry.value).str();
+    try
+    {
+      return ConfigTree::Parser<T>::parse(value);
+    }
+    catch(const std::range_error& e)
+    {
+      std::ostringstream message;
+      message << "Cannot parse value \"" << value
+              << "\" for key \"" << prefix_ << "." << key << "\""
+              << e.what();
+      throw std::range_error(message.str());
+    }
+  }
+
+  /** \brief get value keys in order of appearance */
+  ConfigTree::KeyVector getValueKeys() const
+  {
+    ConfigTree::KeyVector keys;
+    if (node_ == none)
+      return keys;
+    const Node n = node();
+    for (std::uint32_t i = 0; i < n.valueCount; ++i)
+      keys.push_back(string(valueEntry(n.valueBegin + i).key).str());
+    return keys;
+  }
+
+  /** \brief get substructure keys in order of appearance */
+  ConfigTree::KeyVector getSubKeys() const
+  {
+    ConfigTree::KeyVector keys;
+    if (node_ == none)
+      return keys;
+    const Node n = node();
+    for (std::uint32_t i = 0; i < n.subCount; ++i)
+      keys.push_back(string(subEntry(n.subBegin + i).key).str());
+    return keys;
+  }
+
+  /** \brief copy into a ConfigTree */
+  ConfigTree tree() const
+  {
+    ConfigTree pt;
+    copy(pt);
+    return pt;
+  }
+
+  /** \brief write pt in the binary format
+   *
+   * \param typed whether to store integers and floating point numbers
+   *              pre-parsed along with their text
+   */
+  static void write(const ConfigTree& pt, std::ostream& out, bool typed = true)
+  {
+    Writer writer(typed);
+    writer.add(pt);
+    writer.write(out);
+  }
+
+  /** \brief write pt in the binary format to the file with the given name */
+  static void write(const ConfigTree& pt, const std::string& file, bool typed = true)
+  {
+    std::ofstream out(file.c_str(), std::ios::out | std::ios::binary);
+    if (not out)
+      throw std::ofstream::failure("Could not open file " + file + " for writing");
+    write(pt, out, typed);
+    out.close();
+    if (not out)
+      throw std::ofstream::failure("Could not write file " + file);
+  }
+
+  /** \brief 64 bit checksum of size bytes
+   *
+   * Different seeds give independent checksums of the same data.
+   */
+  static std::uint64_t checksum(const char* data, std::size_t size,
+                                std::uint64_t seed = 0)
+  {
+    const std::uint64_t prime = 0x100000001b3ull;
+    std::uint64_t h = (0xcbf29ce484222325ull ^ size) + seed * 0x9e3779b97f4a7c15ull;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+      std::uint64_t w;
+      std::memcpy(&w, data + i, 8);
+      h = (h ^ w) * prime;
+      h ^= h >> 32;
+    }
+    for (; i < size; ++i)
+      h = (h ^ static_cast<unsigned char>(data[i])) * prime;
+    return h ^ (h >> 29);
+  }
+
+private:
+
+  static const std::uint32_t none = 0xffffffffu;
+  static const std::uint32_t byteOrder = 0x01020304u;
+
+  struct Header
+  {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byteOrder;
+    std::uint64_t size;
+    std::uint64_t checksum;
+    std::uint32_t nodes;
+    std::uint32_t values;
+    std::uint32_t subs;
+    std::uint32_t strings;
+    std::uint64_t stringBytes;
+  };
+
+  struct Node
+  {
+    std::uint32_t valueBegin;
+    std::uint32_t valueCount;
+    std::uint32_t subBegin;
+    std::uint32_t subCount;
+  };
+
+  enum Type { text = 0, integer = 1, real = 2 };
+
+  struct ValueEntry
+  {
+    std::uint32_t key;
+    std::uint32_t value;
+    std::uint32_t type;
+    std::uint32_t reserved;
+    // std::int64_t or double, depending on type
+    std::uint64_t number;
+  };
+
+  struct SubEntry
+  {
+    std::uint32_t key;
+    std::uint32_t node;
+  };
+
+  struct StringEntry
+  {
+    std::uint32_t offset;
+    std::uint32_t size;
+  };
+
+  // offsets of the tables, computed from the counts of the header
+  struct Layout
+  {
+    Layout()
+      : nodes(0), values(0), valueOrder(0), subs(0), subOrder(0),
+        strings(0), chars(0), end(0)
+    {}
+
+    explicit Layout(const Header& h)
+    {
+      nodes = align(sizeof(Header));
+      values = align(nodes + std::uint64_t(h.nodes) * sizeof(Node));
+      valueOrder = align(values + std::uint64_t(h.values) * sizeof(ValueEntry));
+      subs = align(valueOrder + std::uint64_t(h.values) * sizeof(std::uint32_t));
+      subOrder = align(subs + std::uint64_t(h.subs) * sizeof(SubEntry));
+      strings = align(subOrder + std::uint64_t(h.subs) * sizeof(std::uint32_t));
+      chars = align(strings + std::uint64_t(h.strings) * sizeof(StringEntry));
+      end = chars + h.stringBytes;
+    }
+
+    static std::uint64_t align(std::uint64_t offset)
+    {
+      return (offset + 7) & ~std::uint64_t(7);
+    }
+
+    std::uint64_t nodes, values, valueOrder, subs, subOrder, strings, chars, end;
+  };
+
+  // pre-parsed value of type T, if it equals the text parse
+  template<typename T, typename Enable = void>
+  struct Typed
+  {
+    static bool get(const ValueEntry&, T&)
+    {
+      return false;
+    }
+  };
+
+  template<typename T>
+  struct Typed<T, typename std::enable_if<std::is_integral<T>::value
+                                          and not std::is_same<T, bool>::value
+                                          and sizeof(T) >= sizeof(short)
+                                          and sizeof(T) <= sizeof(std::int64_t)>::type>
+  {
+    static bool get(const ValueEntry& entry, T& val)
+    {
+      if (entry.type not_eq integer)
+        return false;
+      std::int64_t i;
+      std::memcpy(&i, &entry.number, sizeof(i));
+      // out of range numbers are left to the text parse, which decides
+      // whether they wrap around or fail
+      if (i < 0 and std::is_unsigned<T>::value)
+        return false;
+      if (not std::is_unsigned<T>::value and i < std::int64_t(std::numeric_limits<T>::min()))
+        return false;
+      if (i > 0 and std::uint64_t(i) > std::uint64_t(std::numeric_limits<T>::max()))
+        return false;
+      val = static_cast<T>(i);
+      return true;
+    }
+  };
+
+  template<typename Dummy>
+  struct Typed<double, Dummy>
+  {
+    static bool get(const ValueEntry& entry, double& val)
+    {
+      if (entry.type == real)
+      {
+        std::memcpy(&val, &entry.number, sizeof(val));
+        return true;
+      }
+      std::int64_t i;
+      std::memcpy(&i, &entry.number, sizeof(i));
+      // integers up to 2^53 are exact as double
+      if (entry.type == integer and i <= (std::int64_t(1) << 53)
+          and i >= -(std::int64_t(1) << 53))
+      {
+        val = static_cast<double>(i);
+        return true;
+      }
+      return false;
+    }
+  };
+
+  // builds the tables of a tree
+  class Writer
+  {
+  public:
+
+    explicit Writer(bool typed)
+      : typed_(typed)
+    {}
+
+    void add(const ConfigTree& pt)
+    {
+      // breadth first, so that the entries of each node are contiguous
+      std::vector<const ConfigTree*> queue(1, &pt);
+      for (std::size_t q = 0; q < queue.size(); ++q)
+      {
+        const ConfigTree& t = *queue[q];
+        Node n;
+        n.valueBegin = count(values_.size());
+        n.valueCount = count(t.getValueKeys().size());
+        n.subBegin = count(subs_.size());
+        n.subCount = count(t.getSubKeys().size());
+        nodes_.push_back(n);
+
+        const ConfigTree::KeyVector& valueKeys = t.getValueKeys();
+        for (std::size_t i = 0; i < valueKeys.size(); ++i)
+        {
+          const std::string& value = t[valueKeys[i]];
+          ValueEntry entry = {intern(valueKeys[i]), intern(value), text, 0, 0};
+          if (typed_)
+            parse(value, entry);
+          values_.push_back(entry);
+        }
+        sortedOrder(valueKeys, n.valueBegin, valueOrder_);
+
+        const ConfigTree::KeyVector& subKeys = t.getSubKeys();
+        for (std::size_t i = 0; i < subKeys.size(); ++i)
+        {
+          SubEntry entry = {intern(subKeys[i]), count(queue.size())};
+          subs_.push_back(entry);
+          queue.push_back(&t.sub(subKeys[i]));
+        }
+        sortedOrder(subKeys, n.subBegin, subOrder_);
+      }
+    }
+
+    void write(std::ostream& out)
+    {
+      Header h;
+      std::memcpy(h.magic, "CFGTREE", 8);
+      h.version = version;
+      h.byteOrder = byteOrder;
+      h.nodes = count(nodes_.size());
+      h.values = count(values_.size());
+      h.subs = count(subs_.size());
+      h.strings = count(strings_.size());
+      h.stringBytes = chars_.size();
+      const Layout layout(h);
+      h.size = layout.end;
+
+      std::string data(layout.end, '\0');
+      put(data, layout.nodes, nodes_);
+      put(data, layout.values, values_);
+      put(data, layout.valueOrder, valueOrder_);
+      put(data, layout.subs, subs_);
+      put(data, layout.subOrder, subOrder_);
+      put(data, layout.strings, strings_);
+      data.replace(layout.chars, chars_.size(), chars_);
+      h.checksum = checksum(data.data() + sizeof(Header), data.size() - sizeof(Header));
+      std::memcpy(&data[0], &h, sizeof(Header));
+      out.write(data.data(), data.size());
+    }
+
+  private:
+
+    static std::uint32_t count(std::size_t n)
+    {
+      if (n >= none)
+        throw std::range_error("ConfigTree too large for the binary format");
+      return static_cast<std::uint32_t>(n);
+    }
+
+    template<class T>
+    static void put(std::string& data, std::uint64_t offset, const std::vector<T>& table)
+    {
+      if (not table.empty())
+        std::memcpy(&data[offset], table.data(), table.size() * sizeof(T));
+    }
+
+    std::uint32_t intern(const std::string& s)
+    {
+      std::map<std::string, std::uint32_t>::iterator it = ids_.find(s);
+      if (it not_eq ids_.end())
+        return it->second;
+      StringEntry entry = {count(chars_.size()), count(s.size())};
+      chars_.append(s);
+      chars_ += '\0';
+      std::uint32_t id = count(strings_.size());
+      strings_.push_back(entry);
+      ids_.insert(std::make_pair(s, id));
+      return id;
+    }
+
+    // the indices begin, begin+1, ... of keys, sorted by key
+    static void sortedOrder(const ConfigTree::KeyVector& keys, std::uint32_t begin,
+                            std::vector<std::uint32_t>& order)
+    {
+      std::vector<std::uint32_t> index(keys.size());
+      for (std::size_t i = 0; i < keys.size(); ++i)
+        index[i] = static_cast<std::uint32_t>(i);
+      std::sort(index.begin(), index.end(), [&keys](std::uint32_t a, std::uint32_t b) {
+          return StringView(keys[a]) < StringView(keys[b]);
+        });
+      for (std::size_t i = 0; i < index.size(); ++i)
+        order.push_back(begin + index[i]);
+    }
+
+    // store integers and floating point numbers pre-parsed, if they are
+    // read the same by the text parse
+    static void parse(const std::string& value, ValueEntry& entry)
+    {
+      std::size_t front = value.find_first_not_of(" \t\n\r\v\f");
+      if (front == std::string::npos)
+        return;
+      std::size_t back = value.find_last_not_of(" \t\n\r\v\f") + 1;
+      std::size_t digits = front + (value[front] == '+' or value[front] == '-');
+      if (digits < back and value.find_first_not_of("0123456789", digits) >= back)
+      {
+        errno = 0;
+        std::int64_t i = std::strtoll(value.c_str() + front, nullptr, 10);
+        if (errno == 0)
+        {
+          entry.type = integer;
+          std::memcpy(&entry.number, &i, sizeof(i));
+        }
+        return;
+      }
+      try
+      {
+        double d = ConfigTree::Parser<double>::parse(value);
+        entry.type = real;
+        std::memcpy(&entry.number, &d, sizeof(d));
+      }
+      catch (const std::range_error&)
+      {}
+    }
+
+    bool typed_;
+    std::vector<Node> nodes_;
+    std::vector<ValueEntry> values_;
+    std::vector<std::uint32_t> valueOrder_;
+    std::vector<SubEntry> subs_;
+    std::vector<std::uint32_t> subOrder_;
+    std::vector<StringEntry> strings_;
+    std::string chars_;
+    std::map<std::string, std::uint32_t> ids_;
+  };
+
+  // substructure s of this node, or an empty one for none
+  BinaryConfigTree(const BinaryConfigTree& parent, const std::string& key, std::uint32_t node)
+    : file_(parent.file_), data_(parent.data_), header_(parent.header_),
+      layout_(parent.layout_), node_(node), prefix_(parent.prefix_ + key + ".")
+  {}
+
+  BinaryConfigTree child(const std::string& key, std::uint32_t s) const
+  {
+    return BinaryConfigTree(*this, key, s == none ? none : subEntry(s).node);
+  }
+
+  void open(const char* data, std::size_t size, const std::string& srcname, bool verify)
+  {
+    data_ = data;
+    if (size < sizeof(Header) or std::memcmp(data, "CFGTREE", 8) not_eq 0)
+      fail(srcname, "is not a binary ConfigTree");
+    std::memcpy(&header_, data, sizeof(Header));
+    if (header_.byteOrder not_eq byteOrder)
+      fail(srcname, "was written with another byte order");
+    if (header_.version not_eq version)
+      fail(srcname, "has unsupported format version " + std::to_string(header_.version));
+    layout_ = Layout(header_);
+    if (header_.size not_eq size or layout_.end not_eq size or header_.nodes == 0)
+      fail(srcname, "is truncated or corrupt");
+    if (not verify)
+      return;
+    if (checksum(data + sizeof(Header), size - sizeof(Header)) not_eq header_.checksum)
+      fail(srcname, "has a wrong checksum");
+
+    // all indices stay within their tables
+    for (std::uint32_t i = 0; i < header_.strings; ++i)
+    {
+      const StringEntry s = load<StringEntry>(layout_.strings, i);
+      if (s.offset >= header_.stringBytes or s.size >= header_.stringBytes - s.offset
+          or data[layout_.chars + s.offset + s.size] not_eq '\0')
+        fail(srcname, "is corrupt");
+    }
+    for (std::uint32_t i = 0; i < header_.nodes; ++i)
+    {
+      const Node n = load<Node>(layout_.nodes, i);
+      if (n.valueBegin > header_.values or n.valueCount > header_.values - n.valueBegin
+          or n.subBegin > header_.subs or n.subCount > header_.subs - n.subBegin)
+        fail(srcname, "is corrupt");
+      for (std::uint32_t v = n.valueBegin; v < n.valueBegin + n.valueCount; ++v)
+      {
+        const ValueEntry e = load<ValueEntry>(layout_.values, v);
+        const std::uint32_t o = load<std::uint32_t>(layout_.valueOrder, v);
+        if (e.key >= header_.strings or e.value >= header_.strings
+            or o < n.valueBegin or o >= n.valueBegin + n.valueCount)
+          fail(srcname, "is corrupt");
+      }
+      for (std::uint32_t s = n.subBegin; s < n.subBegin + n.subCount; ++s)
+      {
+        const SubEntry e = load<SubEntry>(layout_.subs, s);
+        const std::uint32_t o = load<std::uint32_t>(layout_.subOrder, s);
+        // children follow their parent, so there are no cycles
+        if (e.key >= header_.strings or e.node <= i or e.node >= header_.nodes
+            or o < n.subBegin or o >= n.subBegin + n.subCount)
+          fail(srcname, "is corrupt");
+      }
+    }
+  }
+
+  static void fail(const std::string& srcname, const std::string& reason)
+  {
+    throw std::range_error("Binary configuration " + srcname + " " + reason);
+  }
+
+  static void conflict(const std::string& key)
+  {
+    std::ostringstream message;
+    message << "key " << key << " occurs as value and as subtree";
+    throw std::range_error(message.str());
+  }
+
+  // element i of the table at offset, read without alignment assumptions
+  template<class T>
+  T load(std::uint64_t offset, std::uint32_t i) const
+  {
+    T t;
+    std::memcpy(&t, data_ + offset + std::uint64_t(i) * sizeof(T), sizeof(T));
+    return t;
+  }
+
+  Node node() const
+  {
+    return load<Node>(layout_.nodes, node_);
+  }
+
+  ValueEntry valueEntry(std::uint32_t i) const
+  {
+    return load<ValueEntry>(layout_.values, i);
+  }
+
+  // entry of an existing key
+  ValueEntry valueEntry(const std::string& key) const
+  {
+    std::string::size_type dot = key.find(".");
+    if (dot not_eq std::string::npos)
+      return sub(key.substr(0,dot)).valueEntry(key.substr(dot+1));
+    return valueEntry(findValue(key));
+  }
+
+  SubEntry subEntry(std::uint32_t i) const
+  {
+    return load<SubEntry>(layout_.subs, i);
+  }
+
+  StringView string(std::uint32_t id) const
+  {
+    const StringEntry s = load<StringEntry>(layout_.strings, id);
+    return StringView(data_ + layout_.chars + s.offset, s.size);
+  }
+
+  // binary search of key in the sorted order of the entries [begin, begin+count)
+  template<class Entry>
+  std::uint32_t find(const std::string& key, std::uint64_t table, std::uint64_t order,
+                     std::uint32_t begin, std::uint32_t count) const
+  {
+    const StringView k(key);
+    std::uint32_t lo = begin, hi = begin + count;
+    while (lo < hi)
+    {
+      std::uint32_t mid = lo + (hi - lo) / 2;
+      std::uint32_t i = load<std::uint32_t>(order, mid);
+      int c = string(load<Entry>(table, i).key).compare(k);
+      if (c == 0)
+        return i;
+      if (c < 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return none;
+  }
+
+  std::uint32_t findValue(const std::string& key) const
+  {
+    if (node_ == none)
+      return none;
+    const Node n = node();
+    return find<ValueEntry>(key, layout_.values, layout_.valueOrder, n.valueBegin, n.valueCount);
+  }
+
+  std::uint32_t findSub(const std::string& key) const
+  {
+    if (node_ == none)
+      return none;
+    const Node n = node();
+    return find<SubEntry>(key, layout_.subs, layout_.subOrder, n.subBegin, n.subCount);
+  }
+
+  void copy(ConfigTree& pt) const
+  {
+    if (node_ == none)
+      return;
+    const Node n = node();
+    for (std::uint32_t i = 0; i < n.valueCount; ++i)
+    {
+      const ValueEntry e = valueEntry(n.valueBegin + i);
+      pt[string(e.key).str()] = string(e.value).str();
+    }
+    for (std::uint32_t i = 0; i < n.subCount; ++i)
+    {
+      const SubEntry e = subEntry(n.subBegin + i);
+      const std::string key = string(e.key).str();
+      BinaryConfigTree(*this, key, e.node).copy(pt.sub(key));
+    }
+  }
+
+  std::shared_ptr<MappedFile> file_;
+  const char* data_;
+  Header header_;
+  Layout layout_;
+  std::uint32_t node_;
+  std::string prefix_;
+};
+
+#endif // BINARYCONFIGTREE_HH
@@ -0,0 +1,271 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef COMPRESSEDFILE_HH
+#define COMPRESSEDFILE_HH
+
+/** \file
+ * \brief Sequential reader of plain, gzip or zstd compressed files
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif // HAVE_ZLIB
+
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif // HAVE_ZSTD
+
+/** \brief Sequential reader of a file that may be compressed
+ *
+ * The format is told by the first bytes of the file: gzip and zstd
+ * streams are decompressed, anything else is read as is. Concatenated
+ * streams are read one after the other, like gzip -d does.
+ *
+ * The file is read in chunks of a fixed size, so the memory used does not
+ * depend on the size of the file. Decompression needs zlib and zstd,
+ * which are optional: HAVE_ZLIB and HAVE_ZSTD tell which are available.
+ */
+class CompressedFile
+{
+public:
+
+  enum Format { plain, gzip, zstd };
+
+  /** \brief open the file with the given name
+   *
+   * \param file filename
+   * \throw std::ifstream::failure if the file cannot be opened
+   * \throw std::range_error if the file is compressed in a format this
+   *        build does not support
+   */
+  explicit CompressedFile(const std::string& file)
+    : name_(file),
+      buffer_(chunkSize), begin_(0), end_(0), format_(plain), finished_(true)
+  {
+    errno = 0;
+    in_.open(file.c_str(), std::ios::in | std::ios::binary);
+    if (not in_)
+    {
+      std::ostringstream message;
+      message << "Could not open configuration file " << file;
+      if (errno not_eq 0)
+        message << " (" << std::strerror(errno) << ")";
+      throw std::ifstream::failure(message.str());
+    }
+    fill();
+    const unsigned char* magic = reinterpret_cast<const unsigned char*>(buffer_.data());
+    const std::size_t n = end_ - begin_;
+    if (n >= 2 and magic[0] == 0x1f and magic[1] == 0x8b)
+      format_ = gzip;
+    else if (n >= 4 and magic[0] == 0x28 and magic[1] == 0xb5
+             and magic[2] == 0x2f and magic[3] == 0xfd)
+      format_ = zstd;
+    if (not supported(format_))
+      fail(std::string(format_ == gzip ? "gzip" : "zstd")
+           + " compressed, which this build does not support");
+
+#if HAVE_ZLIB
+    if (format_ == gzip)
+    {
+      std::memset(&zlib_, 0, sizeof(zlib_));
+      // 16: expect a gzip header
+      if (inflateInit2(&zlib_, 15 + 16) not_eq Z_OK)
+        throw std::bad_alloc();
+    }
+#endif // HAVE_ZLIB
+#if HAVE_ZSTD
+    if (format_ == zstd)
+    {
+      zstd_ = ZSTD_createDStream();
+      if (not zstd_ or ZSTD_isError(ZSTD_initDStream(zstd_)))
+      {
+        ZSTD_freeDStream(zstd_);
+        throw std::bad_alloc();
+      }
+    }
+#endif // HAVE_ZSTD
+  }
+
+  ~CompressedFile()
+  {
+#if HAVE_ZLIB
+    if (format_ == gzip)
+      inflateEnd(&zlib_);
+#endif // HAVE_ZLIB
+#if HAVE_ZSTD
+    if (format_ == zstd)
+      ZSTD_freeDStream(zstd_);
+#endif // HAVE_ZSTD
+  }
+
+  CompressedFile(const CompressedFile&) = delete;
+  CompressedFile& operator=(const CompressedFile&) = delete;
+
+  /** \brief whether files of the given format can be read */
+  static bool supported(Format format)
+  {
+    switch (format)
+    {
+#if not HAVE_ZLIB
+    case gzip:
+      return false;
+#endif // not HAVE_ZLIB
+#if not HAVE_ZSTD
+    case zstd:
+      return false;
+#endif // not HAVE_ZSTD
+    default:
+      return true;
+    }
+  }
+
+  /** \brief format of the file */
+  Format format() const
+  {
+    return format_;
+  }
+
+  /** \brief read up to size bytes of the contents into data
+   *
+   * \return the number of bytes read, 0 at the end of the contents
+   * \throw std::range_error if the compressed data is corrupt or truncated
+   */
+  std::size_t read(char* data, std::size_t size)
+  {
+    switch (format_)
+    {
+#if HAVE_ZLIB
+    case gzip:
+      return readGzip(data, size);
+#endif // HAVE_ZLIB
+#if HAVE_ZSTD
+    case zstd:
+      return readZstd(data, size);
+#endif // HAVE_ZSTD
+    default:
+      return readPlain(data, size);
+    }
+  }
+
+  /** \brief size of the chunks read from the file */
+  static const std::size_t chunkSize = 1 << 16;
+
+private:
+
+  // refill the input buffer if it is empty, false at the end of the file
+  bool fill()
+  {
+    if (begin_ < end_)
+      return true;
+    in_.read(&buffer_[0], buffer_.size());
+    begin_ = 0;
+    end_ = in_.gcount();
+    return end_ > 0;
+  }
+
+  void fail(const std::string& what) const
+  {
+    std::ostringstream message;
+    message << "Configuration file " << name_ << " is " << what;
+    throw std::range_error(message.str());
+  }
+
+  std::size_t readPlain(char* data, std::size_t size)
+  {
+    std::size_t n = 0;
+    while (n < size and fill())
+    {
+      const std::size_t step = std::min(size - n, end_ - begin_);
+      std::memcpy(data + n, &buffer_[begin_], step);
+      begin_ += step;
+      n += step;
+    }
+    return n;
+  }
+
+#if HAVE_ZLIB
+  std::size_t readGzip(char* data, std::size_t size)
+  {
+    // zlib counts in unsigned int
+    size = std::min<std::size_t>(size, 1u << 30);
+    zlib_.next_out = reinterpret_cast<Bytef*>(data);
+    zlib_.avail_out = size;
+    while (zlib_.avail_out > 0)
+    {
+      // without more input, output may still be pending
+      const bool more = fill();
+      if (not more and finished_)
+        break;
+      if (more and finished_)
+      {
+        // another stream follows
+        inflateReset(&zlib_);
+        finished_ = false;
+      }
+      zlib_.next_in = more ? reinterpret_cast<Bytef*>(&buffer_[begin_]) : nullptr;
+      zlib_.avail_in = more ? end_ - begin_ : 0;
+      const int result = inflate(&zlib_, Z_NO_FLUSH);
+      begin_ = end_ - zlib_.avail_in;
+      if (result == Z_STREAM_END)
+        finished_ = true;
+      else if (result == Z_BUF_ERROR and not more)
+        fail("truncated");
+      else if (result not_eq Z_OK)
+        fail("not valid gzip data");
+    }
+    return size - zlib_.avail_out;
+  }
+#endif // HAVE_ZLIB
+
+#if HAVE_ZSTD
+  std::size_t readZstd(char* data, std::size_t size)
+  {
+    ZSTD_outBuffer out = {data, size, 0};
+    while (out.pos < out.size)
+    {
+      // without more input, output may still be pending
+      const bool more = fill();
+      if (not more and finished_)
+        break;
+      ZSTD_inBuffer in = {more ? &buffer_[begin_] : nullptr, more ? end_ - begin_ : 0, 0};
+      const std::size_t before = out.pos;
+      const std::size_t result = ZSTD_decompressStream(zstd_, &out, &in);
+      begin_ += in.pos;
+      if (ZSTD_isError(result))
+        fail(std::string("not valid zstd data (") + ZSTD_getErrorName(result) + ")");
+      // 0 once a frame is complete, the next one starts by itself
+      finished_ = (result == 0);
+      if (not more and not finished_ and out.pos == before)
+        fail("truncated");
+    }
+    return out.pos;
+  }
+#endif // HAVE_ZSTD
+
+  std::string name_;
+  std::ifstream in_;
+  // compressed input, the unread part is [begin_, end_)
+  std::vector<char> buffer_;
+  std::size_t begin_;
+  std::size_t end_;
+  Format format_;
+  // whether the last stream ended, so that the input may end here
+  bool finished_;
+#if HAVE_ZLIB
+  z_stream zlib_;
+#endif // HAVE_ZLIB
+#if HAVE_ZSTD
+  ZSTD_DStream* zstd_;
+#endif // HAVE_ZSTD
+};
+
+#endif // COMPRESSEDFILE_HH
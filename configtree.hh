@@ -4,10 +4,21 @@
 #define CONFIGTREE_HH
 
 #include <sstream>
+#include <iostream>
+#include <array>
+#include <vector>
 #include <map>
 #include <fstream>
 #include <algorithm>
 #include <bitset>
+#include <atomic>
+#include <cstring>
+#include <cctype>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 
 #if HAVE_EIGEN
 #include <Eigen/Core>
@@ -17,10 +28,30 @@
 #include "classname.hh"
 
 /** \brief Hierarchical structure of string parameters
+ *
+ * With setInterpolation(), values may refer to other values as
+ * \c ${key}, with key the full dotted name from the root of the tree, e.g.
+ * \code
+ * base = /scratch
+ * [output]
+ * dir = ${base}/run/${case.name}
+ * \endcode
+ * The references are resolved by get(), when a value is first read, and
+ * the result is kept until one of the values it was built from is
+ * changed. operator[] always gives the value as written; \c $${ stands
+ * for a literal \c ${ .
+ *
  * \ingroup Common
  */
 class ConfigTree
 {
+  friend class ConfigTreeParser;
+  friend class BinaryConfigTree;
+  friend class ConfigTreePatch;
+  friend class INIWriter;
+  friend class JSONParser;
+  friend class JSONWriter;
+
   // class providing a single static parse() function, used by the
   // generic get() method
   // template specializations follow below
@@ -36,8 +67,52 @@ public:
   /** \brief Create new empty ParameterTree
    */
   ConfigTree()
+    : parent_(nullptr), interpolate_(false), tracking_(false), hashed_(false), hash_(0)
   {}
 
+  /** \brief Copy a tree, or a substructure as a new root
+   */
+  ConfigTree(const ConfigTree& other)
+    : prefix_(other.prefix_), valueKeys_(other.valueKeys_), subKeys_(other.subKeys_),
+      values_(other.values_), subs_(other.subs_), parent_(nullptr),
+      interpolate_(other.interpolation()), tracking_(other.locationTracking()),
+      hashed_(other.hashed_), hash_(other.hash_), sources_(other.root().sources_)
+  {
+    adopt();
+  }
+
+  ConfigTree(ConfigTree&& other)
+    : prefix_(std::move(other.prefix_)), valueKeys_(std::move(other.valueKeys_)),
+      subKeys_(std::move(other.subKeys_)), values_(std::move(other.values_)),
+      subs_(std::move(other.subs_)), parent_(nullptr),
+      interpolate_(other.interpolation()), tracking_(other.locationTracking()),
+      hashed_(other.hashed_), hash_(other.hash_), sources_(other.root().sources_)
+  {
+    adopt();
+    // other is left empty
+    other.forgetResolved();
+    other.touch();
+  }
+
+  /** \brief Replace the contents of this tree, which keeps its place in
+   *         an enclosing tree
+   */
+  ConfigTree& operator=(ConfigTree other)
+  {
+    prefix_.swap(other.prefix_);
+    valueKeys_.swap(other.valueKeys_);
+    subKeys_.swap(other.subKeys_);
+    values_.swap(other.values_);
+    subs_.swap(other.subs_);
+    interpolate_ = other.interpolate_;
+    tracking_ = other.tracking_;
+    sources_.swap(other.sources_);
+    adopt();
+    touch();
+    forgetResolved();
+    return *this;
+  }
+
 
   /** \brief test for key
    *
@@ -147,7 +222,10 @@ public:
     {
       if (not hasKey(key))
         valueKeys_.push_back(key);
-      return values_[key];
+      touch();
+      Value& v = values_[key];
+      forget(v);
+      return v.value;
     }
   }
 
@@ -178,14 +256,15 @@ public:
         message << "Key '" << key << "' not found in ParameterTree (prefix " + prefix_ + ")";
         throw std::range_error(message.str());
       }
-      return values_.find(key)->second;
+      return values_.find(key)->second.value;
     }
   }
 
 
   /** \brief print distinct substructure to stream
    *
-   * Prints all entries with given prefix.
+   * Prints all entries with given prefix. Meant for reading by humans:
+   * INIWriter writes output that reads back into the same tree.
    *
    * \param stream Stream to print to
    * \param prefix for key and substructure names
@@ -193,19 +272,19 @@ public:
   void report(std::ostream& stream = std::cout,
               const std::string& prefix = "") const
   {
-    typedef std::map<std::string, std::string>::const_iterator ValueIt;
+    typedef ValueMap::const_iterator ValueIt;
     ValueIt vit = values_.begin();
     ValueIt vend = values_.end();
 
     for(; vit not_eq vend; ++vit)
-      stream << vit->first << " = \"" << vit->second << "\"" << std::endl;
+      stream << vit->first << " = \"" << vit->second.value << "\"" << '\n';
 
     typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
     SubIt sit = subs_.begin();
     SubIt send = subs_.end();
     for(; sit not_eq send; ++sit)
     {
-      stream << "[ " << prefix + prefix_ + sit->first << " ]" << std::endl;
+      stream << "[ " << prefix + prefix_ + sit->first << " ]" << '\n';
       (sit->second).report(stream, prefix);
     }
   }
@@ -234,9 +313,14 @@ public:
         throw std::range_error(message.str());
       }
       if (subs_.count(key) == 0)
+      {
         subKeys_.push_back(key.substr(0,dot));
-      subs_[key].prefix_ = prefix_ + key + ".";
-      return subs_[key];
+        touch();
+      }
+      ConfigTree& s = subs_[key];
+      s.prefix_ = prefix_ + key + ".";
+      s.parent_ = this;
+      return s;
     }
   }
 
@@ -291,7 +375,7 @@ public:
   std::string get(const std::string& key, const std::string& defaultValue) const
   {
     if (hasKey(key))
-      return (*this)[key];
+      return value(key);
     else
       return defaultValue;
   }
@@ -309,7 +393,7 @@ public:
   std::string get(const std::string& key, const char* defaultValue) const
   {
     if (hasKey(key))
-      return (*this)[key];
+      return value(key);
     else
       return defaultValue;
   }
@@ -350,17 +434,21 @@ public:
       message << "Key '" << key << "' not found in ParameterTree (prefix " + prefix_ + ")";
       throw std::range_error(message.str());
     }
+    const std::string v = value(key);
     try
     {
-      return Parser<T>::parse((*this)[key]);
+      return Parser<T>::parse(v);
     }
     catch(const std::range_error& e)
     {
       // rethrow the error and add more information
       std::ostringstream message;
-      message << "Cannot parse value \"" << (*this)[key]
+      message << "Cannot parse value \"" << v
               << "\" for key \"" << prefix_ << "." << key << "\""
               << e.what();
+      const Location where = location(key);
+      if (not where.source.empty())
+        message << " (read from " << where.source << ", line " << where.line << ")";
       throw std::range_error(message.str());
     }
   }
@@ -390,6 +478,163 @@ public:
     return subKeys_;
   }
 
+
+  /** \brief merge another tree into this one
+   *
+   * Adds all values and substructures of other, new keys are appended
+   * in their order of appearance in other. The result is the same as
+   * assigning every value of other to this tree via operator[].
+   *
+   * \param other     tree to merge
+   * \param overwrite Whether to overwrite already existing values.
+   * \throw std::range_error if a key is a value in one tree and a
+   *        substructure in the other. This tree is left unchanged then.
+   */
+  void merge(const ConfigTree& other, bool overwrite = true)
+  {
+    std::string conflict;
+    if (not mergeable(other, false, conflict))
+    {
+      std::ostringstream message;
+      message << "key " << conflict << " occurs as value and as subtree";
+      throw std::range_error(message.str());
+    }
+    addSources(other);
+    mergeInto(other, overwrite);
+  }
+
+  /** \brief merge another tree into this one, taking over its contents
+   *
+   * Like merge(const ConfigTree&, bool), but moves values and whole
+   * substructures out of other instead of copying them.
+   */
+  void merge(ConfigTree&& other, bool overwrite = true)
+  {
+    std::string conflict;
+    if (not mergeable(other, false, conflict))
+    {
+      std::ostringstream message;
+      message << "key " << conflict << " occurs as value and as subtree";
+      throw std::range_error(message.str());
+    }
+    addSources(other);
+    mergeInto(other, overwrite);
+  }
+
+  /** \brief hash of the contents of this tree
+   *
+   * Covers the keys and values and the substructures, but not the order
+   * of the keys, nor the locations of the values. Trees with equal
+   * contents have equal hashes on every platform, so the hash of a
+   * substructure can name artifacts derived from it.
+   *
+   * Every tree keeps its hash until it or one of its substructures is
+   * changed, so only the substructures changed since the last call are
+   * hashed again. The non-const operator[] and sub() count as changes
+   * when called: a reference to a value must not be kept to change it
+   * after the next call of hash().
+   */
+  std::uint64_t hash() const
+  {
+    std::lock_guard<std::mutex> lock(hashMutex());
+    return computeHash();
+  }
+
+  /** \brief whether both trees have the same contents
+   *
+   * Compares like hash() does. Trees with different hashes differ, which
+   * is told without traversing them; equal trees are traversed to
+   * confirm the hashes.
+   */
+  bool operator==(const ConfigTree& other) const
+  {
+    return this == &other or (hash() == other.hash() and equal(other));
+  }
+
+  /** \brief whether the trees have different contents, see operator==() */
+  bool operator!=(const ConfigTree& other) const
+  {
+    return not (*this == other);
+  }
+
+  /** \brief enable or disable the resolution of references by get()
+   *
+   * Applies to the whole tree this one belongs to, and is disabled by
+   * default, so that values like shell scripts are read as written. A
+   * copy of a substructure is a tree of its own: it keeps the setting,
+   * but resolves references against its own keys.
+   *
+   * A value changed through a reference kept from operator[] after it
+   * was used by get() is not seen by the resolved values; assign it
+   * through operator[] again.
+   */
+  void setInterpolation(bool enable = true)
+  {
+    root().interpolate_ = enable;
+    forgetResolved();
+  }
+
+  /** \brief whether get() resolves references, see setInterpolation() */
+  bool interpolation() const
+  {
+    return root().interpolate_;
+  }
+
+  /** \brief origin of a value, see location() */
+  struct Location
+  {
+    //! name of the source as in the errors of the parser, e.g. "file
+    //! 'a.ini'", or empty if unknown
+    std::string source;
+    //! line counting from 1, 0 if unknown
+    std::size_t line;
+  };
+
+  /** \brief enable or disable recording where values are read from
+   *
+   * Applies to the whole tree this one belongs to and to the values read
+   * by later calls of the ConfigTreeParser functions; disabled by
+   * default. The tree keeps one entry per source read, and every value
+   * its line in the space the value node already has, so tracking does
+   * not grow the tree per key. Values created through the non-const
+   * operator[] and values loaded from a ParseCache have no location. The
+   * tree cannot tell reads from writes through the reference operator[]
+   * returns, so a value changed that way keeps the location it was read
+   * from.
+   */
+  void setLocationTracking(bool enable = true)
+  {
+    root().tracking_ = enable;
+  }
+
+  /** \brief whether the parser records locations, see setLocationTracking() */
+  bool locationTracking() const
+  {
+    return root().tracking_;
+  }
+
+  /** \brief source and line the value of key was read from
+   *
+   * Also reported in the errors of get(). Values of included files are
+   * located in the included file.
+   *
+   * \throw std::range_error if the key does not exist
+   */
+  Location location(const std::string& key) const
+  {
+    const Value* v = findValue(key);
+    if (not v)
+    {
+      std::ostringstream message;
+      message << "Key '" << key << "' not found in ParameterTree (prefix " + prefix_ + ")";
+      throw std::range_error(message.str());
+    }
+    Location where = {root().sourceName(v->source), v->line};
+    if (where.source.empty())
+      where.line = 0;
+    return where;
+  }
+
 protected:
 
   // static const ConfigTree empty_;
@@ -399,9 +644,483 @@ protected:
   KeyVector valueKeys_;
   KeyVector subKeys_;
 
-  std::map<std::string, std::string> values_;
+  // a value, along with the parse that last read it
+  struct Value
+  {
+    Value()
+      : source(0), line(0)
+    {}
+
+    std::string value;
+    unsigned int source;
+    // line of the value in source, if tracked; fills the padding after
+    // source
+    std::uint32_t line;
+  };
+
+  typedef std::map<std::string, Value> ValueMap;
+
+  ValueMap values_;
   std::map<std::string, ConfigTree> subs_;
 
+  // the enclosing tree, nullptr for a root
+  ConfigTree* parent_;
+  // whether get() resolves references, used at the root
+  bool interpolate_;
+  // the resolved values of a root, and for each value referenced the
+  // values resolved with it
+  struct Resolved
+  {
+    std::unordered_map<const Value*, std::string> values;
+    std::unordered_map<const Value*, std::unordered_set<const Value*> > dependents;
+  };
+  mutable std::unique_ptr<Resolved> resolved_;
+  // whether the parser records locations, used at the root
+  bool tracking_;
+  // whether hash_ holds the hash of the current contents. A node without
+  // a hash has no hashed ancestors, so invalidating stops at the first
+  // node found invalid.
+  mutable bool hashed_;
+  mutable std::uint64_t hash_;
+
+  // names of the parses values were read by, ordered by source id;
+  // copies share the table, which is never modified in place
+  typedef std::vector<std::pair<unsigned int, std::string> > SourceTable;
+  std::shared_ptr<const SourceTable> sources_;
+
+  // value node for key, created like operator[] does if it does not
+  // exist yet, which created reports
+  Value& valueNode(const std::string& key, bool& created)
+  {
+    std::string::size_type dot = key.find(".");
+
+    if (dot not_eq std::string::npos)
+    {
+      ConfigTree& s = sub(key.substr(0,dot));
+      return s.valueNode(key.substr(dot+1), created);
+    }
+    created = not hasKey(key);
+    if (created)
+      valueKeys_.push_back(key);
+    touch();
+    Value& v = values_[key];
+    forget(v);
+    return v;
+  }
+
+  // set the value of key, created if needed; the value then has no
+  // location
+  void assign(const std::string& key, const std::string& value)
+  {
+    bool created;
+    Value& v = valueNode(key, created);
+    v.value = value;
+    v.source = 0;
+    v.line = 0;
+  }
+
+  // a new identifier for a parse, to tell the values read by it apart
+  static unsigned int newSource()
+  {
+    static std::atomic<unsigned int> sources(0);
+    return ++sources;
+  }
+
+  // check whether other can be merged into this tree, i.e. that no key
+  // is a value in one tree and a substructure in the other. If unique,
+  // values present in both trees count as conflict, too. Returns false
+  // and the full name of the first conflicting key otherwise.
+  bool mergeable(const ConfigTree& other, bool unique,
+                 std::string& conflict) const
+  {
+    typedef ValueMap::const_iterator ValueIt;
+    for (ValueIt vit = other.values_.begin(); vit not_eq other.values_.end(); ++vit)
+      if (subs_.count(vit->first) > 0
+          or (unique and values_.count(vit->first) > 0))
+      {
+        conflict = prefix_ + vit->first;
+        return false;
+      }
+
+    typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
+    for (SubIt sit = other.subs_.begin(); sit not_eq other.subs_.end(); ++sit)
+    {
+      if (values_.count(sit->first) > 0)
+      {
+        conflict = prefix_ + sit->first;
+        return false;
+      }
+      SubIt mine = subs_.find(sit->first);
+      if (mine not_eq subs_.end()
+          and not mine->second.mergeable(sit->second, unique, conflict))
+        return false;
+    }
+    return true;
+  }
+
+  // merge other into this tree, the caller has checked mergeable().
+  // Values and substructures are copied from a const other and moved
+  // out of a non-const one.
+  template<class Tree>
+  void mergeInto(Tree& other, bool overwrite)
+  {
+    forgetResolved();
+    touch();
+    for (KeyVector::const_iterator it = other.valueKeys_.begin();
+         it not_eq other.valueKeys_.end(); ++it)
+    {
+      auto& value = other.values_.find(*it)->second;
+      ValueMap::iterator mine = values_.find(*it);
+      if (mine == values_.end())
+      {
+        valueKeys_.push_back(*it);
+        mine = values_.insert(std::make_pair(*it, Value())).first;
+      }
+      else if (not overwrite)
+        continue;
+      take(mine->second.value, value.value);
+      mine->second.source = value.source;
+      mine->second.line = value.line;
+    }
+
+    for (KeyVector::const_iterator it = other.subKeys_.begin();
+         it not_eq other.subKeys_.end(); ++it)
+    {
+      auto& sub = other.subs_.find(*it)->second;
+      std::map<std::string, ConfigTree>::iterator mine = subs_.find(*it);
+      if (mine == subs_.end())
+      {
+        subKeys_.push_back(*it);
+        ConfigTree& target = subs_[*it];
+        take(target, sub);
+        target.parent_ = this;
+        target.setPrefix(prefix_ + *it + ".");
+      }
+      else
+        mine->second.mergeInto(sub, overwrite);
+    }
+  }
+
+  // copy or move a value or substructure for mergeInto()
+  static void take(std::string& target, const std::string& source)
+  {
+    target = source;
+  }
+
+  static void take(std::string& target, std::string& source)
+  {
+    target.swap(source);
+  }
+
+  static void take(ConfigTree& target, const ConfigTree& source)
+  {
+    target = source;
+  }
+
+  static void take(ConfigTree& target, ConfigTree& source)
+  {
+    target = std::move(source);
+  }
+
+  // guards the resolved values, which const methods update
+  static std::mutex& resolvedMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  // guards the hashes, which const methods update
+  static std::mutex& hashMutex()
+  {
+    static std::mutex mutex;
+    return mutex;
+  }
+
+  // whether the hashes of both trees are known and equal, without
+  // computing them
+  bool knownEqualHash(const ConfigTree& other) const
+  {
+    std::lock_guard<std::mutex> lock(hashMutex());
+    return hashed_ and other.hashed_ and hash_ == other.hash_;
+  }
+
+  // invalidate the hashes of this tree and the enclosing ones
+  void touch()
+  {
+    for (ConfigTree* t = this; t and t->hashed_; t = t->parent_)
+      t->hashed_ = false;
+  }
+
+  // FNV-1a over the bytes of n, least significant first
+  static std::uint64_t hashAdd(std::uint64_t h, std::uint64_t n)
+  {
+    for (int i = 0; i < 8; ++i, n >>= 8)
+      h = (h ^ (n & 0xff)) * 0x100000001b3ull;
+    return h;
+  }
+
+  // FNV-1a over the length and the characters of s
+  static std::uint64_t hashAdd(std::uint64_t h, const std::string& s)
+  {
+    h = hashAdd(h, std::uint64_t(s.size()));
+    for (std::size_t i = 0; i < s.size(); ++i)
+      h = (h ^ static_cast<unsigned char>(s[i])) * 0x100000001b3ull;
+    return h;
+  }
+
+  // hash(), with the lock held
+  std::uint64_t computeHash() const
+  {
+    if (hashed_)
+      return hash_;
+    std::uint64_t h = 0xcbf29ce484222325ull;
+    h = hashAdd(h, std::uint64_t(values_.size()));
+    for (ValueMap::const_iterator vit = values_.begin(); vit not_eq values_.end(); ++vit)
+      h = hashAdd(hashAdd(h, vit->first), vit->second.value);
+    h = hashAdd(h, std::uint64_t(subs_.size()));
+    typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
+    for (SubIt sit = subs_.begin(); sit not_eq subs_.end(); ++sit)
+      h = hashAdd(hashAdd(h, sit->first), sit->second.computeHash());
+    hash_ = h;
+    hashed_ = true;
+    return h;
+  }
+
+  // whether the contents equal those of other, whose hash is the same
+  bool equal(const ConfigTree& other) const
+  {
+    if (values_.size() not_eq other.values_.size() or subs_.size() not_eq other.subs_.size())
+      return false;
+    for (ValueMap::const_iterator vit = values_.begin(), oit = other.values_.begin();
+         vit not_eq values_.end(); ++vit, ++oit)
+      if (vit->first not_eq oit->first or vit->second.value not_eq oit->second.value)
+        return false;
+    typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
+    for (SubIt sit = subs_.begin(), oit = other.subs_.begin(); sit not_eq subs_.end(); ++sit, ++oit)
+      if (sit->first not_eq oit->first or not sit->second.equal(oit->second))
+        return false;
+    return true;
+  }
+
+  const ConfigTree& root() const
+  {
+    const ConfigTree* root = this;
+    while (root->parent_)
+      root = root->parent_;
+    return *root;
+  }
+
+  ConfigTree& root()
+  {
+    ConfigTree* root = this;
+    while (root->parent_)
+      root = root->parent_;
+    return *root;
+  }
+
+  // record the name of a parse, for the locations of its values
+  void addSource(unsigned int source, const std::string& name)
+  {
+    SourceTable entry(1, std::make_pair(source, name));
+    addSources(entry);
+  }
+
+  // record the names of the parses of other's values
+  void addSources(const ConfigTree& other)
+  {
+    const ConfigTree& from = other.root();
+    if (from.sources_ and from.sources_ not_eq root().sources_)
+      addSources(*from.sources_);
+  }
+
+  void addSources(const SourceTable& entries)
+  {
+    ConfigTree& r = root();
+    std::shared_ptr<SourceTable> table = std::make_shared<SourceTable>();
+    if (r.sources_)
+      *table = *r.sources_;
+    for (std::size_t i = 0; i < entries.size(); ++i)
+    {
+      SourceTable::iterator it = std::lower_bound(table->begin(), table->end(), entries[i]);
+      if (it == table->end() or it->first not_eq entries[i].first)
+        table->insert(it, entries[i]);
+    }
+    r.sources_ = table;
+  }
+
+  // name of a parse, empty if unknown; called on the root
+  std::string sourceName(unsigned int source) const
+  {
+    if (not sources_ or source == 0)
+      return std::string();
+    SourceTable::const_iterator it = std::lower_bound(
+      sources_->begin(), sources_->end(), std::make_pair(source, std::string()));
+    return (it not_eq sources_->end() and it->first == source) ? it->second : std::string();
+  }
+
+  // point the substructures to this tree after copying or moving them
+  void adopt()
+  {
+    typedef std::map<std::string, ConfigTree>::iterator SubIt;
+    for (SubIt sit = subs_.begin(); sit not_eq subs_.end(); ++sit)
+      sit->second.parent_ = this;
+  }
+
+  // value node for key, or nullptr
+  const Value* findValue(const std::string& key) const
+  {
+    std::string::size_type dot = key.find(".");
+
+    if (dot not_eq std::string::npos)
+    {
+      std::map<std::string, ConfigTree>::const_iterator s = subs_.find(key.substr(0,dot));
+      return s == subs_.end() ? nullptr : s->second.findValue(key.substr(dot+1));
+    }
+    ValueMap::const_iterator v = values_.find(key);
+    return v == values_.end() ? nullptr : &v->second;
+  }
+
+  // value for key, with its references resolved if enabled
+  std::string value(const std::string& key) const
+  {
+    const Value* v = findValue(key);
+    if (not v)
+      return (*this)[key];
+    if (v->value.find('$') == std::string::npos or not interpolation())
+      return v->value;
+    Chain chain;
+    return root().resolve(*v, prefix_ + key, chain);
+  }
+
+  // the values being resolved, to detect cycles
+  typedef std::vector<std::pair<const Value*, std::string> > Chain;
+
+  // v with its references resolved against this tree, which is the root
+  std::string resolve(const Value& v, const std::string& key, Chain& chain) const
+  {
+    {
+      std::lock_guard<std::mutex> lock(resolvedMutex());
+      if (resolved_)
+      {
+        std::unordered_map<const Value*, std::string>::const_iterator it
+          = resolved_->values.find(&v);
+        if (it not_eq resolved_->values.end())
+          return it->second;
+      }
+    }
+
+    for (std::size_t i = 0; i < chain.size(); ++i)
+      if (chain[i].first == &v)
+      {
+        std::ostringstream message;
+        message << "Cyclic reference in key '" << chain[i].second << "': ";
+        for (std::size_t j = i; j < chain.size(); ++j)
+          message << chain[j].second << " -> ";
+        message << key;
+        throw std::range_error(message.str());
+      }
+    chain.push_back(std::make_pair(&v, key));
+
+    const std::string& s = v.value;
+    std::string result;
+    std::vector<const Value*> targets;
+    std::size_t pos = 0;
+    for (std::size_t dollar = s.find('$'); dollar not_eq std::string::npos;
+         dollar = s.find('$', pos))
+    {
+      result.append(s, pos, dollar - pos);
+      if (s.compare(dollar, 3, "$${") == 0)
+      {
+        result += "${";
+        pos = dollar + 3;
+        continue;
+      }
+      if (s.compare(dollar, 2, "${") not_eq 0)
+      {
+        result += '$';
+        pos = dollar + 1;
+        continue;
+      }
+      std::size_t close = s.find('}', dollar + 2);
+      if (close == std::string::npos)
+      {
+        std::ostringstream message;
+        message << "Unterminated reference in value of key '" << key << "'";
+        throw std::range_error(message.str());
+      }
+      const std::string name = rtrim(ltrim(s.substr(dollar + 2, close - dollar - 2)));
+      const Value* target = findValue(name);
+      if (not target)
+      {
+        std::ostringstream message;
+        message << "Key '" << name << "' referenced by key '" << key << "' not found";
+        throw std::range_error(message.str());
+      }
+      if (target->value.find('$') == std::string::npos)
+        result += target->value;
+      else
+        result += resolve(*target, name, chain);
+      targets.push_back(target);
+      pos = close + 1;
+    }
+    result.append(s, pos, std::string::npos);
+    chain.pop_back();
+
+    std::lock_guard<std::mutex> lock(resolvedMutex());
+    if (not resolved_)
+      resolved_.reset(new Resolved);
+    resolved_->values[&v] = result;
+    for (std::size_t i = 0; i < targets.size(); ++i)
+      resolved_->dependents[targets[i]].insert(&v);
+    return result;
+  }
+
+  // drop the resolved value of v, which is about to change, and those
+  // resolved with it
+  void forget(const Value& v)
+  {
+    ConfigTree& r = root();
+    if (not r.resolved_)
+      return;
+    std::lock_guard<std::mutex> lock(resolvedMutex());
+    forget(*r.resolved_, &v);
+  }
+
+  static void forget(Resolved& resolved, const Value* v)
+  {
+    resolved.values.erase(v);
+    std::unordered_map<const Value*, std::unordered_set<const Value*> >::iterator it
+      = resolved.dependents.find(v);
+    if (it == resolved.dependents.end())
+      return;
+    // erased first, so that the recursion ends on stale cyclic entries
+    std::unordered_set<const Value*> dependents;
+    dependents.swap(it->second);
+    resolved.dependents.erase(it);
+    for (std::unordered_set<const Value*>::const_iterator d = dependents.begin();
+         d not_eq dependents.end(); ++d)
+      forget(resolved, *d);
+  }
+
+  // drop all resolved values of the tree, after changes to many values
+  void forgetResolved()
+  {
+    ConfigTree& r = root();
+    if (not r.resolved_)
+      return;
+    std::lock_guard<std::mutex> lock(resolvedMutex());
+    r.resolved_.reset();
+  }
+
+  // set the prefix of this tree and all its substructures
+  void setPrefix(const std::string& prefix)
+  {
+    prefix_ = prefix;
+    typedef std::map<std::string, ConfigTree>::iterator SubIt;
+    for (SubIt sit = subs_.begin(); sit not_eq subs_.end(); ++sit)
+      sit->second.setPrefix(prefix + sit->first + ".");
+  }
+
   static std::string ltrim(const std::string& s)
   {
     std::size_t firstNonWS = s.find_first_not_of(" \t\n\r");
@@ -511,9 +1230,12 @@ struct ConfigTree::Parser<std::basic_string<char, traits, Allocator> >
   static std::basic_string<char, traits, Allocator>
   parse(const std::string& str)
   {
-    std::string trimmed = ltrim(rtrim(str));
-    return std::basic_string<char, traits, Allocator>(trimmed.begin(),
-                                                      trimmed.end());
+    std::size_t front = str.find_first_not_of(" \t\n\r");
+    if (front == std::string::npos)
+      return std::basic_string<char, traits, Allocator>();
+    std::size_t back = str.find_last_not_of(" \t\n\r") + 1;
+    return std::basic_string<char, traits, Allocator>(str.begin() + front,
+                                                      str.begin() + back);
   }
 };
 
@@ -571,26 +1293,165 @@ struct ConfigTree::Parser<std::array<T, n> >
   }
 };
 
+/** \brief parser for std::bitset
+ *
+ * Besides the list of n whitespace separated boolean tokens (token i
+ * gives bit i) a single compact token is accepted:
+ * - \c 0x... hexadecimal and \c 0b... binary literals, read like the
+ *   std::bitset string constructor (the rightmost digit is bit 0),
+ * - comma separated lists of bit indices and inclusive index ranges,
+ *   e.g. \c 0-127,512-1023 .
+ */
 template<std::size_t n>
 struct ConfigTree::Parser<std::bitset<n> >
 {
   static std::bitset<n>
   parse(const std::string& str)
   {
-    std::bitset<n> val;
-    std::vector<std::string> sub = split(str);
-    if (sub.size() not_eq n)
+    std::size_t front = str.find_first_not_of(" \t\n\r");
+    if (front not_eq std::string::npos)
+    {
+      std::size_t back = str.find_last_not_of(" \t\n\r") + 1;
+      std::size_t gap = str.find_first_of(" \t\n\r", front);
+      // a single token is compact, unless it is the one token of a bitset<1>
+      if ((gap == std::string::npos or gap >= back)
+          and (n not_eq 1 or isCompact(str, front, back)))
+        return parseCompact(str, front, back);
+    }
+
+    std::size_t count = 0;
+    for (std::size_t pos = front; pos not_eq std::string::npos; ++count)
+      pos = str.find_first_not_of(" \t\n\r", str.find_first_of(" \t\n\r", pos));
+    if (count not_eq n)
     {
       std::ostringstream message;
-      message << "as a bitset<" << n << "> " << "because of unmatching size " << sub.size();
+      message << "as a bitset<" << n << "> " << "because of unmatching size " << count;
       throw std::range_error(message.str());
     }
+
+    std::bitset<n> val;
+    std::size_t pos = front;
     for (std::size_t i=0; i<n; ++i)
     {
-      val[i] = ConfigTree::Parser<bool>::parse(sub[i]);
+      std::size_t end = str.find_first_of(" \t\n\r", pos);
+      if (end == std::string::npos)
+        end = str.size();
+      // the plain 0/1 tokens do not need a round trip through Parser<bool>
+      if (end - pos == 1 and (str[pos] == '0' or str[pos] == '1'))
+        val[i] = (str[pos] == '1');
+      else
+        val[i] = ConfigTree::Parser<bool>::parse(str.substr(pos, end-pos));
+      pos = str.find_first_not_of(" \t\n\r", end);
     }
     return val;
   }
+
+private:
+
+  static bool isCompact(const std::string& str, std::size_t front, std::size_t back)
+  {
+    if (back - front > 2 and str[front] == '0'
+        and std::strchr("xXbB", str[front+1]) not_eq nullptr)
+      return true;
+    return std::isdigit(static_cast<unsigned char>(str[front]))
+      and str.find_first_of(",-", front) < back;
+  }
+
+  static void fail(const std::string& str, const char* reason)
+  {
+    std::ostringstream message;
+    message << "as a bitset<" << n << "> " << "because '" << str << "' " << reason;
+    throw std::range_error(message.str());
+  }
+
+  // or a 64 bit word into val, starting at bit offset
+  static void orWord(std::bitset<n>& val, unsigned long long word,
+                     std::size_t offset, const std::string& str)
+  {
+    if (word == 0)
+      return;
+    if (offset >= n or (n - offset < 64 and (word >> (n - offset)) not_eq 0))
+      fail(str, "has more significant bits than the bitset holds");
+    val |= std::bitset<n>(word) << offset;
+  }
+
+  static std::bitset<n>
+  parseCompact(const std::string& str, std::size_t front, std::size_t back)
+  {
+    std::bitset<n> val;
+    if (back - front > 2 and str[front] == '0'
+        and (str[front+1] == 'x' or str[front+1] == 'X'
+             or str[front+1] == 'b' or str[front+1] == 'B'))
+    {
+      // walk the digits from the least significant one, collecting a
+      // machine word at a time
+      const bool hex = (str[front+1] == 'x' or str[front+1] == 'X');
+      const unsigned bits = hex ? 4 : 1;
+      unsigned long long word = 0;
+      unsigned filled = 0;
+      std::size_t offset = 0;
+      for (std::size_t i = back; i > front+2; --i)
+      {
+        char c = str[i-1];
+        unsigned digit;
+        if (c >= '0' and c <= '9')
+          digit = c - '0';
+        else if (c >= 'a' and c <= 'f')
+          digit = c - 'a' + 10;
+        else if (c >= 'A' and c <= 'F')
+          digit = c - 'A' + 10;
+        else
+          digit = 16;
+        if (digit >= (1u << bits))
+          fail(str, "contains an invalid digit");
+        word |= static_cast<unsigned long long>(digit) << filled;
+        filled += bits;
+        if (filled == 64)
+        {
+          orWord(val, word, offset, str);
+          offset += 64;
+          word = 0;
+          filled = 0;
+        }
+      }
+      orWord(val, word, offset, str);
+      return val;
+    }
+
+    // list of indices and ranges
+    const std::bitset<n> all = ~std::bitset<n>();
+    std::size_t pos = front;
+    while (pos < back)
+    {
+      std::size_t lo = parseIndex(str, pos, back);
+      std::size_t hi = lo;
+      if (pos < back and str[pos] == '-')
+        hi = parseIndex(str, ++pos, back);
+      if (pos < back and str[pos] not_eq ',')
+        fail(str, "is not a list of bit indices and ranges");
+      if (pos < back and ++pos == back)
+        fail(str, "ends with a separator");
+      if (lo > hi or hi >= n)
+        fail(str, "contains an index range outside of the bitset");
+      val |= (all >> (n - (hi - lo + 1))) << lo;
+    }
+    return val;
+  }
+
+  static std::size_t parseIndex(const std::string& str, std::size_t& pos,
+                                std::size_t back)
+  {
+    if (pos == back or not std::isdigit(static_cast<unsigned char>(str[pos])))
+      fail(str, "is not a list of bit indices and ranges");
+    std::size_t index = 0;
+    for (; pos < back and std::isdigit(static_cast<unsigned char>(str[pos])); ++pos)
+    {
+      index = 10*index + (str[pos] - '0');
+      if (index > n)
+        index = n; // saturate, the range check reports it
+    }
+    return index;
+  }
 };
 
 template<typename T, typename A>
@@ -0,0 +1,739 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "binaryconfigtree.hh"
+#include "configtreeparser.hh"
+#include "configtreepatch.hh"
+#include "iniclassifier.hh"
+#include "iniwriter.hh"
+#include "jsonparser.hh"
+#include "jsonwriter.hh"
+#include "lazyconfigtree.hh"
+
+// Benchmarks for the ConfigTree parsers.
+//
+// usage: configtreebench [benchmark] [size]
+// Runs all benchmarks if none is given; size scales the generated input.
+
+typedef std::chrono::steady_clock Clock;
+
+// run f repeatedly and report the best wall time in milliseconds
+template<class F>
+double bestOf(int runs, F f)
+{
+  double best = 1e300;
+  for (int r = 0; r < runs; ++r)
+  {
+    Clock::time_point start = Clock::now();
+    f();
+    std::chrono::duration<double, std::milli> t = Clock::now() - start;
+    best = std::min(best, t.count());
+  }
+  return best;
+}
+
+void report(const std::string& name, double ms, std::size_t bytes)
+{
+  std::printf("%-36s %10.2f ms %10.1f MB/s\n", name.c_str(), ms,
+              bytes / (1024.0 * 1024.0) / (ms / 1000.0));
+}
+
+// generate INI text with the given number of sections, keys per
+// section and some comments and quoted values mixed in
+std::string generateINI(std::size_t sections, std::size_t keys)
+{
+  std::ostringstream out;
+  for (std::size_t s = 0; s < sections; ++s)
+  {
+    out << "# section " << s << "\n"
+        << "[group" << s % 97 << ".section" << s << "]\n";
+    for (std::size_t k = 0; k < keys; ++k)
+    {
+      out << "key" << k << " = ";
+      if (k % 7 == 0)
+        out << "\"quoted value " << k << "\"";
+      else
+        out << k * s << " " << k + s << " " << k;
+      if (k % 5 == 0)
+        out << " # trailing comment";
+      out << "\n";
+    }
+  }
+  return out.str();
+}
+
+std::size_t writeINIFile(const std::string& filename,
+                         std::size_t sections, std::size_t keys)
+{
+  std::ofstream out(filename.c_str());
+  std::string contents = generateINI(sections, keys);
+  out << contents;
+  return contents.size();
+}
+
+// compare reading a file through std::ifstream with the mapped file path
+void benchMappedFile(std::size_t size)
+{
+  const std::string filename = "configtreebench.ini";
+  std::size_t bytes = writeINIFile(filename, 100 * size, 100);
+
+  double stream = bestOf(3, [&]{
+      ConfigTree pt;
+      std::ifstream in(filename.c_str());
+      ConfigTreeParser::readINITree(in, pt);
+    });
+  report("readINITree(istream)", stream, bytes);
+
+  double mapped = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(filename, pt);
+    });
+  report("readINITree(file)", mapped, bytes);
+
+  for (unsigned int threads = 2; threads <= std::max(4u, std::thread::hardware_concurrency()); threads *= 2)
+  {
+    double parallel = bestOf(3, [&]{
+        ConfigTree pt;
+        ConfigTreeParser::readINITreeParallel(filename, pt, true, threads);
+      });
+    report("readINITreeParallel(file), " + std::to_string(threads) + " threads",
+           parallel, bytes);
+  }
+
+  std::remove(filename.c_str());
+}
+
+// time from opening a file to the first lookup, parsing the whole file
+// versus loading only the section looked up
+void benchLazy(std::size_t size)
+{
+  const std::string filename = "configtreebench.ini";
+  std::size_t bytes = writeINIFile(filename, 100 * size, 100);
+  const std::string key = "group" + std::to_string(size % 97) + ".section"
+    + std::to_string(size) + ".key1";
+
+  double full = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(filename, pt);
+      if (pt.get<std::string>(key).empty())
+        std::abort();
+    });
+  report("first lookup, readINITree(file)", full, bytes);
+
+  double lazy = bestOf(3, [&]{
+      LazyConfigTree pt(filename);
+      if (pt.get<std::string>(key).empty())
+        std::abort();
+    });
+  report("first lookup, LazyConfigTree", lazy, bytes);
+
+  std::remove(filename.c_str());
+}
+
+// start-up from the INI text versus from the binary format, and the
+// cost of lookups in either
+void benchBinary(std::size_t size)
+{
+  const std::string filename = "configtreebench.ini";
+  const std::string binaryname = "configtreebench.bin";
+  std::size_t bytes = writeINIFile(filename, 100 * size, 100);
+  ConfigTree pt;
+  ConfigTreeParser::readINITree(filename, pt);
+  BinaryConfigTree::write(pt, binaryname);
+  const std::string key = "group" + std::to_string(size % 97) + ".section"
+    + std::to_string(size) + ".key1";
+
+  double ini = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(filename, pt);
+      if (pt.get(key, "").empty())
+        std::abort();
+    });
+  report("load and lookup, INI", ini, bytes);
+
+  double binary = bestOf(3, [&]{
+      BinaryConfigTree pt(binaryname);
+      if (pt.get(key, "").empty())
+        std::abort();
+    });
+  report("load and lookup, binary", binary, bytes);
+
+  BinaryConfigTree view(binaryname);
+  const int lookups = 100000;
+  std::size_t sink = 0;
+  double tree = bestOf(3, [&]{
+      for (int i = 0; i < lookups; ++i)
+        sink += pt.get(key, "").size();
+    });
+  std::printf("%-36s %10.3f us\n", "get(), ConfigTree", tree * 1000 / lookups);
+  double inPlace = bestOf(3, [&]{
+      for (int i = 0; i < lookups; ++i)
+        sink += view.get(key, "").size();
+    });
+  std::printf("%-36s %10.3f us\n", "get(), binary", inPlace * 1000 / lookups);
+  if (sink == 42)
+    std::printf("\n");
+
+  std::remove(filename.c_str());
+  std::remove(binaryname.c_str());
+}
+
+// reading an unchanged file through the parse cache
+void benchCache(std::size_t size)
+{
+  const std::string filename = "configtreebench.ini";
+  std::size_t bytes = writeINIFile(filename, 100 * size, 100);
+  ParseCache cache(".");
+
+  double parse = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(filename, pt);
+    });
+  report("readINITree(file)", parse, bytes);
+
+  double cached = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(filename, pt, cache);
+    });
+  report("readINITree(file, cache)", cached, bytes);
+  std::printf("%-36s %10.2f\n", "cache hit rate", cache.hitRate());
+
+  MappedFile contents(filename);
+  std::remove(cache.entry(contents.data(), contents.size()).c_str());
+  std::remove(filename.c_str());
+}
+
+// resolving references on first get() and from the memoized results,
+// against replacing them in all values up front
+void benchInterpolate(std::size_t size)
+{
+  const std::size_t sections = 100 * size;
+  const std::size_t keys = 1000;
+  ConfigTree pt;
+  pt.setInterpolation();
+  pt["base"] = "/scratch/project";
+  pt["case.name"] = "cavity";
+  pt["unrelated"] = "0";
+  std::vector<std::string> names;
+  for (std::size_t s = 0; s < sections; ++s)
+    for (std::size_t k = 0; k < keys; ++k)
+    {
+      names.push_back("run" + std::to_string(s) + ".output" + std::to_string(k));
+      pt[names.back()] = "${base}/run/${case.name}/" + std::to_string(k);
+    }
+  std::printf("%-36s %10zu\n", "interpolated values", names.size());
+
+  std::size_t sink = 0;
+  double eager = bestOf(1, [&]{
+      ConfigTree copy = pt;
+      copy.setInterpolation(false);
+      const std::string base = copy.get("base", "");
+      const std::string name = copy.get("case.name", "");
+      for (std::size_t i = 0; i < names.size(); ++i)
+      {
+        std::string& v = copy[names[i]];
+        std::string::size_type p;
+        while ((p = v.find("${base}")) not_eq std::string::npos)
+          v.replace(p, 7, base);
+        while ((p = v.find("${case.name}")) not_eq std::string::npos)
+          v.replace(p, 12, name);
+      }
+      sink += copy.get(names[0], "").size();
+    });
+  std::printf("%-36s %10.2f ms\n", "replace all, then get one", eager);
+
+  double first = bestOf(1, [&]{
+      sink += pt.get(names[names.size() / 2], "").size();
+    });
+  std::printf("%-36s %10.3f ms\n", "get(), first of one value", first);
+
+  double all = bestOf(1, [&]{
+      for (std::size_t i = 0; i < names.size(); ++i)
+        sink += pt.get(names[i], "").size();
+    });
+  std::printf("%-36s %10.2f ms\n", "get(), first of all values", all);
+
+  double memoized = bestOf(3, [&]{
+      for (std::size_t i = 0; i < names.size(); ++i)
+        sink += pt.get(names[i], "").size();
+    });
+  std::printf("%-36s %10.2f ms\n", "get(), memoized, all values", memoized);
+
+  pt["unrelated"] = "1";
+  double other = bestOf(1, [&]{
+      for (std::size_t i = 0; i < names.size(); ++i)
+        sink += pt.get(names[i], "").size();
+    });
+  std::printf("%-36s %10.2f ms\n", "get(), after an unrelated change", other);
+
+  pt["base"] = "/tmp";
+  double changed = bestOf(1, [&]{
+      for (std::size_t i = 0; i < names.size(); ++i)
+        sink += pt.get(names[i], "").size();
+    });
+  std::printf("%-36s %10.2f ms\n", "get(), after a change, all values", changed);
+  if (sink == 42)
+    std::printf("\n");
+}
+
+// files checked per second by the linter, on one thread and on all
+void benchLint(std::size_t size)
+{
+  std::vector<std::string> files;
+  std::size_t bytes = 0;
+  for (std::size_t i = 0; i < 400 * size; ++i)
+  {
+    files.push_back("configtreebench" + std::to_string(i) + ".ini");
+    bytes += writeINIFile(files.back(), 5, 20);
+  }
+  ConfigTreeParser::INILinter linter;
+  linter.expect<int>("group0.section0.key1");
+
+  for (unsigned int threads = 1; threads <= std::thread::hardware_concurrency(); threads *= 2)
+  {
+    std::size_t diagnostics = 0;
+    double ms = bestOf(3, [&]{
+        diagnostics = linter.lint(files, threads).size();
+      });
+    std::printf("%-36s %10.0f files/s %6zu diagnostics\n",
+                ("lint, " + std::to_string(threads) + " threads").c_str(),
+                files.size() / (ms / 1000.0), diagnostics);
+  }
+  report("lint, throughput on all threads", bestOf(3, [&]{ linter.lint(files); }), bytes);
+
+  for (std::size_t i = 0; i < files.size(); ++i)
+    std::remove(files[i].c_str());
+}
+
+// throughput of the delimiter classification and of the tokenizer
+// alone, without inserting into a tree
+void benchScanner(std::size_t size)
+{
+  std::string ini = generateINI(500 * size, 100);
+  const char* data = ini.data();
+  const std::size_t blocks = ini.size() / INIClassifier::blockSize;
+  std::uint64_t sink = 0;
+
+  double scalar = bestOf(5, [&]{
+      INIClassifier::Masks masks;
+      for (std::size_t i = 0; i < blocks; ++i)
+      {
+        INIClassifier::classifyScalar(data + i * INIClassifier::blockSize, masks);
+        sink += masks.select(~0u);
+      }
+    });
+  report("INIClassifier::classifyScalar", scalar, blocks * INIClassifier::blockSize);
+
+  double simd = bestOf(5, [&]{
+      INIClassifier::Masks masks;
+      for (std::size_t i = 0; i < blocks; ++i)
+      {
+        INIClassifier::classify(data + i * INIClassifier::blockSize, masks);
+        sink += masks.select(~0u);
+      }
+    });
+  report("INIClassifier::classify", simd, blocks * INIClassifier::blockSize);
+
+  double scan = bestOf(5, [&]{
+      INIScanner scanner(data, data + ini.size());
+      INIScanner::Token token;
+      while (scanner.next(token))
+        sink += token.value.size();
+    });
+  report("INIScanner", scan, ini.size());
+
+  if (sink == 42)
+    std::printf("\n");
+}
+
+// quoted values of 10^5 and 10^6 lines, the cost per line should not
+// grow with the length of the value
+void benchMultiline(std::size_t size)
+{
+  for (std::size_t lines = 10000 * size; lines <= 100000 * size; lines *= 10)
+  {
+    std::ostringstream out;
+    out << "script = \"\n";
+    for (std::size_t i = 0; i < lines; ++i)
+      out << "  row " << i << " = \"cell\" 'x' " << i * 7 << "\n";
+    out << "\"\nafter = 1\n";
+    const std::string ini = out.str();
+
+    double ms = bestOf(3, [&]{
+        ConfigTree pt;
+        ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+        if (pt.get<std::string>("script").size() < lines)
+          std::abort();
+      });
+    report("quoted value, " + std::to_string(lines) + " lines", ms, ini.size());
+  }
+}
+
+// where the time of a parse goes, and what measuring it costs
+void benchStats(std::size_t size)
+{
+  const std::string filename = "configtreebench.ini";
+  std::size_t bytes = writeINIFile(filename, 100 * size, 100);
+  double plain = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(filename, pt);
+    });
+  report("readINITree(file)", plain, bytes);
+  ParseStats stats;
+  double measured = bestOf(3, [&]{
+      ConfigTree pt;
+      stats = ParseStats();
+      ConfigTreeParser::readINITree(filename, pt, stats);
+    });
+  report("readINITree(file), with ParseStats", measured, bytes);
+  stats.report(std::cout);
+
+  ParseStats streamed;
+  {
+    ConfigTree pt;
+    std::ifstream in(filename.c_str());
+    ConfigTreeParser::readINITree(in, pt, streamed);
+  }
+  std::cout << "readINITree(istream):\n";
+  streamed.report(std::cout);
+  std::remove(filename.c_str());
+}
+
+// keys in sections nested depth levels deep
+void benchSections(std::size_t size)
+{
+  for (std::size_t depth = 1; depth <= 16; depth *= 4)
+  {
+    std::ostringstream out;
+    for (std::size_t s = 0; s < 100 * size; ++s)
+    {
+      out << "[";
+      for (std::size_t d = 1; d < depth; ++d)
+        out << "level" << d << "_" << s % (d + 1) << ".";
+      out << "section" << s << "]\n";
+      for (std::size_t k = 0; k < 100; ++k)
+        out << "key" << k << " = " << k << "\n";
+    }
+    const std::string ini = out.str();
+    double ms = bestOf(3, [&]{
+        ConfigTree pt;
+        ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+      });
+    report("section depth " + std::to_string(depth), ms, ini.size());
+    ms = bestOf(3, [&]{
+        ConfigTree pt;
+        ConfigTreeParser::readINITreeParallel(ini.data(), ini.size(), pt, "buffer", true, 4);
+      });
+    report("section depth " + std::to_string(depth) + ", 4 threads", ms, ini.size());
+  }
+}
+
+// peak resident set size of the process in MB
+double peakRSS()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss / 1024.0;
+}
+
+// cost of recording source locations, in parse time and heap per key
+void benchLocations(std::size_t size)
+{
+  const std::string ini = generateINI(100 * size, 100);
+  const std::size_t keys = 10000 * size;
+  for (int track = 0; track < 2; ++track)
+  {
+    double ms = bestOf(3, [&]{
+        ConfigTree pt;
+        pt.setLocationTracking(track);
+        ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+      });
+    std::size_t before = ParseStats::heapInUse();
+    std::size_t bytes;
+    {
+      ConfigTree pt;
+      pt.setLocationTracking(track);
+      ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+      bytes = ParseStats::heapInUse() - before;
+    }
+    std::printf("%-36s %10.2f ms %10.1f bytes/key\n",
+                track ? "parse, tracking locations" : "parse, no locations",
+                ms, double(bytes) / keys);
+  }
+}
+
+// many distinct keys, reports time and peak memory of the parse. Run it
+// on its own, the peak covers the whole process.
+void benchKeys(std::size_t size)
+{
+  const std::string ini = generateINI(5000 * size, 100);
+  double before = peakRSS();
+  double ms = bestOf(1, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+    });
+  report(std::to_string(500000 * size) + " keys", ms, ini.size());
+  std::printf("%-36s %10.1f MB (input %.1f MB)\n", "peak RSS during parse",
+              peakRSS() - before, ini.size() / (1024.0 * 1024.0));
+}
+
+// reading a gzip compressed file while decompressing it, against
+// decompressing it to a temporary file first. Reports time and peak
+// memory; run it on its own, the peak covers the whole process.
+void benchCompressed(std::size_t size)
+{
+#if HAVE_ZLIB
+  // mostly comments, so that the tree stays small
+  const char* filename = "configtreebench.ini.gz";
+  std::string comments;
+  for (int i = 0; i < 1000; ++i)
+    comments += "# a line of commentary describing the setting below it\n";
+  std::size_t bytes = 0;
+  gzFile gz = gzopen(filename, "wb");
+  for (std::size_t b = 0; b < 200 * size; ++b)
+  {
+    std::string block = comments + "key" + std::to_string(b) + " = " + std::to_string(b) + "\n";
+    gzwrite(gz, block.data(), block.size());
+    bytes += block.size();
+  }
+  gzclose(gz);
+
+  double before = peakRSS();
+  double ms = bestOf(1, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readCompressedINITree(filename, pt);
+    });
+  report("streaming decompression", ms, bytes);
+  std::printf("%-36s %10.1f MB (input %.1f MB)\n", "peak RSS, streaming",
+              peakRSS() - before, bytes / (1024.0 * 1024.0));
+
+  before = peakRSS();
+  ms = bestOf(1, [&]{
+      const char* temporary = "configtreebench.ini";
+      {
+        std::ofstream out(temporary, std::ios::binary);
+        gzFile in = gzopen(filename, "rb");
+        char buffer[1 << 16];
+        int n;
+        while ((n = gzread(in, buffer, sizeof(buffer))) > 0)
+          out.write(buffer, n);
+        gzclose(in);
+      }
+      ConfigTree pt;
+      ConfigTreeParser::readINITree(temporary, pt);
+      std::remove(temporary);
+    });
+  report("temporary file, mapped", ms, bytes);
+  std::printf("%-36s %10.1f MB (input %.1f MB)\n", "peak RSS, temporary file",
+              peakRSS() - before, bytes / (1024.0 * 1024.0));
+  std::remove(filename);
+#else
+  std::printf("compressed: built without zlib\n");
+#endif
+}
+
+// writing a tree of 100000 * size keys in the INI format, through
+// report() and INIWriter
+void benchWrite(std::size_t size)
+{
+  ConfigTree pt;
+  {
+    const std::string ini = generateINI(1000 * size, 100);
+    ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+  }
+  const std::size_t bytes = INIWriter::str(pt).size();
+  double ms = bestOf(3, [&]{
+      std::ostringstream out;
+      pt.report(out);
+    });
+  report("report(ostringstream)", ms, bytes);
+  ms = bestOf(3, [&]{
+      std::ofstream out("configtreebench.ini");
+      pt.report(out);
+    });
+  report("report(file)", ms, bytes);
+  ms = bestOf(3, [&]{ INIWriter::str(pt); });
+  report("INIWriter::str", ms, bytes);
+  ms = bestOf(3, [&]{ INIWriter::str(pt, INIWriter::sorted); });
+  report("INIWriter::str, sorted", ms, bytes);
+  ms = bestOf(3, [&]{ INIWriter::write(pt, "configtreebench.ini"); });
+  report("INIWriter::write(file)", ms, bytes);
+  std::remove("configtreebench.ini");
+}
+
+// parsing the same tree from INI and from JSON, and writing it as JSON
+void benchJSON(std::size_t size)
+{
+  const std::string ini = generateINI(100 * size, 100);
+  ConfigTree pt;
+  ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+  const std::string json = JSONWriter::str(pt);
+  double ms = bestOf(3, [&]{
+      ConfigTree t;
+      ConfigTreeParser::readINITree(ini.data(), ini.size(), t);
+    });
+  report("readINITree", ms, ini.size());
+  ms = bestOf(3, [&]{
+      ConfigTree t;
+      JSONParser::readJSONTree(json.data(), json.size(), t);
+    });
+  report("readJSONTree", ms, json.size());
+  ms = bestOf(3, [&]{ JSONWriter::str(pt); });
+  report("JSONWriter::str", ms, json.size());
+  std::printf("%-36s %10.1f MB INI, %.1f MB JSON\n", "input size",
+              ini.size() / (1024.0 * 1024.0), json.size() / (1024.0 * 1024.0));
+}
+
+// number of values differing between a and b, found by looking up every
+// key of a in b
+std::size_t lookupDiff(const ConfigTree& a, const ConfigTree& b)
+{
+  std::size_t differing = 0;
+  const ConfigTree::KeyVector& values = a.getValueKeys();
+  for (std::size_t i = 0; i < values.size(); ++i)
+    differing += not b.hasKey(values[i]) or a[values[i]] not_eq b[values[i]];
+  const ConfigTree::KeyVector& subs = a.getSubKeys();
+  for (std::size_t i = 0; i < subs.size(); ++i)
+    differing += lookupDiff(a.sub(subs[i]), b.sub(subs[i]));
+  return differing;
+}
+
+// comparing two trees of 100000 * size keys, 1000 of which differ
+void benchDiff(std::size_t size)
+{
+  const std::string ini = generateINI(1000 * size, 100);
+  ConfigTree a;
+  ConfigTreeParser::readINITree(ini.data(), ini.size(), a);
+  ConfigTree b(a);
+  for (std::size_t s = 0; s < 1000 * size; s += size)
+    b["group" + std::to_string(s % 97) + ".section" + std::to_string(s) + ".key1"] = "x";
+  std::size_t differing = 0;
+  double ms = bestOf(3, [&]{ differing = lookupDiff(a, b); });
+  report("lookup per key, " + std::to_string(differing) + " differ", ms, ini.size());
+  ConfigTreePatch patch;
+  ms = bestOf(3, [&]{ patch = ConfigTreePatch::diff(a, b); });
+  report("ConfigTreePatch::diff, " + std::to_string(patch.changes().size()) + " differ",
+         ms, ini.size());
+  // equal sections with known hashes are confirmed without diffing them
+  a.hash();
+  b.hash();
+  ms = bestOf(3, [&]{ ConfigTreePatch::diff(a, b); });
+  report("ConfigTreePatch::diff, hashes known", ms, ini.size());
+  ms = bestOf(3, [&]{ ConfigTreePatch::diff(a, a); });
+  std::printf("%-36s %10.2f ms\n", "ConfigTreePatch::diff, same tree", ms);
+  const std::string text = patch.str();
+  ConfigTree c(a);
+  ms = bestOf(1, [&]{ ConfigTreePatch::parse(text).apply(c); });
+  report("parse and apply patch", ms, text.size());
+}
+
+// hashing a tree of 100000 * size keys, and again after changes
+void benchHash(std::size_t size)
+{
+  const std::string ini = generateINI(1000 * size, 100);
+  ConfigTree pt;
+  ConfigTreeParser::readINITree(ini.data(), ini.size(), pt);
+  const ConfigTree copy(pt);
+  const ConfigTree& section = pt.sub("group5.section5");
+  double ms = bestOf(1, [&]{ pt.hash(); });
+  std::printf("%-36s %10.2f ms\n", "hash, first call", ms);
+  ms = bestOf(3, [&]{ pt["group5.section5.key1"] += "x"; pt.hash(); });
+  std::printf("%-36s %10.3f ms\n", "hash, after changing a value", ms);
+  ms = bestOf(3, [&]{ section.hash(); });
+  std::printf("%-36s %10.3f ms\n", "hash of a section, unchanged", ms);
+  ms = bestOf(3, [&]{
+      std::ostringstream out;
+      section.report(out);
+      std::hash<std::string>()(out.str());
+    });
+  std::printf("%-36s %10.3f ms\n", "hash of report() of a section", ms);
+  bool equal = true;
+  ms = bestOf(3, [&]{ equal = (pt == copy); });
+  std::printf("%-36s %10.3f ms\n", equal ? "operator==, wrong" : "operator==, trees differ", ms);
+  pt = copy;
+  pt.hash();
+  ms = bestOf(3, [&]{ equal = (pt == copy); });
+  std::printf("%-36s %10.2f ms\n", equal ? "operator==, equal trees" : "operator==, wrong", ms);
+}
+
+// named options: a command line with every keyword of a specification
+void benchOptions(std::size_t size)
+{
+  const std::size_t n = 1000 * size;
+  std::vector<std::string> keywords, args(1, "prog");
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    keywords.push_back("option" + std::to_string(i));
+    args.push_back("--" + keywords.back() + "=" + std::to_string(i));
+  }
+  std::vector<char*> argv;
+  for (std::size_t i = 0; i < args.size(); ++i)
+    argv.push_back(&args[i][0]);
+  double ms = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readNamedOptions(argv.size(), argv.data(), pt, keywords);
+    });
+  std::printf("%-36s %10.2f ms\n", "options, keywords", ms);
+  ConfigTreeParser::OptionSpec spec;
+  for (std::size_t i = 0; i < n; ++i)
+    spec.add(keywords[i]);
+  ms = bestOf(3, [&]{
+      ConfigTree pt;
+      ConfigTreeParser::readNamedOptions(argv.size(), argv.data(), pt, spec);
+    });
+  std::printf("%-36s %10.2f ms\n", "options, OptionSpec", ms);
+}
+
+int main(int argc, char** argv)
+{
+  std::string which = (argc > 1) ? argv[1] : "all";
+  std::size_t size = (argc > 2) ? std::atoi(argv[2]) : 10;
+
+  if (which == "all" or which == "mmap")
+    benchMappedFile(size);
+  if (which == "keys")
+    benchKeys(size);
+  if (which == "compressed")
+    benchCompressed(size);
+  if (which == "all" or which == "lazy")
+    benchLazy(size);
+  if (which == "all" or which == "binary")
+    benchBinary(size);
+  if (which == "all" or which == "cache")
+    benchCache(size);
+  if (which == "all" or which == "interpolate")
+    benchInterpolate(size);
+  if (which == "all" or which == "locations")
+    benchLocations(size);
+  if (which == "all" or which == "lint")
+    benchLint(size);
+  if (which == "all" or which == "multiline")
+    benchMultiline(size);
+  if (which == "all" or which == "stats")
+    benchStats(size);
+  if (which == "all" or which == "sections")
+    benchSections(size);
+  if (which == "all" or which == "scanner")
+    benchScanner(size);
+  if (which == "all" or which == "write")
+    benchWrite(size);
+  if (which == "all" or which == "json")
+    benchJSON(size);
+  if (which == "all" or which == "diff")
+    benchDiff(size);
+  if (which == "all" or which == "hash")
+    benchHash(size);
+  if (which == "all" or which == "options")
+    benchOptions(size);
+
+  return 0;
+}
@@ -8,33 +8,88 @@
  */
 
 #include <istream>
+#include <limits>
 #include <string>
 #include <vector>
-#include <set>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
+#include <mutex>
 
+#include "compressedfile.hh"
 #include "configtree.hh"
+#include "iniscanner.hh"
+#include "mappedfile.hh"
+#include "parsecache.hh"
+#include "parsestats.hh"
 
 class ConfigTreeParser
 {
+  friend class LazyConfigTree;
 
-  static std::string ltrim(const std::string& s)
-  {
-    std::size_t firstNonWS = s.find_first_not_of(" \t\n\r");
+public :
 
-    if (firstNonWS not_eq std::string::npos)
-      return s.substr(firstNonWS);
-    return std::string();
-  }
-  static std::string rtrim(const std::string& s)
+  /** \brief parsed include files
+   *
+   * Every file included while reading INI sources with the same cache is
+   * parsed only once. The cache assumes that the files do not change
+   * while it is in use. It may be shared between threads.
+   */
+  class FragmentCache
   {
-    std::size_t lastNonWS = s.find_last_not_of(" \t\n\r");
+  public:
 
-    if (lastNonWS not_eq std::string::npos)
-      return s.substr(0, lastNonWS+1);
-    return std::string();
-  }
+    /** \brief number of files parsed */
+    std::size_t size() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      return fragments_.size();
+    }
 
-public :
+    /** \brief names of the files parsed, as resolved from the include
+     *         directives
+     */
+    std::vector<std::string> files() const
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      std::vector<std::string> result;
+      for (auto it = fragments_.begin(); it not_eq fragments_.end(); ++it)
+        result.push_back(it->first);
+      return result;
+    }
+
+    /** \brief forget all files */
+    void clear()
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      fragments_.clear();
+    }
+
+  private:
+    friend class ConfigTreeParser;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<const ConfigTree> > fragments_;
+  };
+
+  /** \brief a problem found in an INI source by INILinter */
+  struct Diagnostic
+  {
+    enum Severity { warning, error };
+
+    Severity severity;
+    //! file name, or the name of the source given for a buffer
+    std::string source;
+    //! position counting from 1, 0 if the problem has no position
+    std::size_t line;
+    std::size_t column;
+    std::string message;
+  };
 
   /** @name Parsing methods for the INITree file format
    *
@@ -77,6 +132,16 @@ public :
    * 'prefix'.  Leading and trailing spaces and tabs are removed from the
    * values unless you use single or double quotes around them.  Using single
    * or double quotes you can also have multiline values.
+   *
+   * A line 'include file' or an entry 'include = file' reads the entries
+   * of another INI file, as if they appeared at that place below the
+   * current section: a section '[b]' in the file included from section
+   * '[a]' becomes '[a.b]', and the section of the including file is
+   * unaffected after the include. Relative names are resolved against the
+   * directory of the including file, or against the working directory
+   * for streams and buffers. A file that includes itself, directly or
+   * indirectly, is an error. A file included several times is parsed
+   * once.
    */
   //@{
 
@@ -117,84 +182,37 @@ public :
                           const std::string srcname = "stream",
                           bool overwrite = true)
   {
-    std::string prefix;
-    std::set<std::string> keysInFile;
-    while(not in.eof())
-    {
-      std::string line;
-      getline(in, line);
-      line = ltrim(line);
-      if (line.size() == 0)
-        continue;
-      switch (line[0]) {
-      case '#' :
-        break;
-      case '[' :
-        line = rtrim(line);
-        if (line[line.length()-1] == ']')
-        {
-          prefix = rtrim(ltrim(line.substr(1, line.length()-2)));
-          if (prefix != "")
-            prefix += ".";
-        }
-        break;
-      default :
-        std::string::size_type comment = line.find("#");
-        line = line.substr(0,comment);
-        std::string::size_type mid = line.find("=");
-        if (mid not_eq std::string::npos)
-        {
-          std::string key = prefix+rtrim(ltrim(line.substr(0, mid)));
-          std::string value = ltrim(line.substr(mid+1));
-
-          if (value.length()>0)
-          {
-            // handle quoted strings
-            if ((value[0]=='\'') or (value[0]=='"'))
-            {
-              char quote = value[0];
-              value=value.substr(1);
-              while (*(rtrim(value).rbegin()) not_eq quote)
-              {
-                if (not in.eof())
-                {
-                  std::string l;
-                  getline(in, l);
-                  value = value+"\n"+l;
-                }
-                else
-                  value = value+quote;
-              }
-              value = rtrim(value);
-              value = value.substr(0,value.length()-1);
-            }
-            else
-              value = rtrim(value);
-          }
+    readStream(in, pt, srcname, overwrite, nullptr);
+  }
 
-          if (keysInFile.count(key) not_eq 0)
-          {
-            std::ostringstream message;
-            message << "Key '" << key << "' appears twice in " << srcname << " !";
-            throw std::range_error(message.str());
-          }
-          else
-          {
-            if(overwrite or not pt.hasKey(key))
-              pt[key] = value;
-            keysInFile.insert(key);
-          }
-        }
-        break;
-      }
-    }
 
+  /** \brief parse character buffer
+   *
+   * Parses the characters data[0] ... data[size-1] in place and build
+   * hierarchical config structure. Keys and values are only copied
+   * when they are stored in the tree.
+   *
+   * \param data    Start of the buffer to parse
+   * \param size    Number of characters in the buffer
+   * \param[out] pt      The parameter tree to store the config structure.
+   * \param srcname Name of the configuration source for error
+   *                messages.
+   * \param overwrite Whether to overwrite already existing values.
+   *                  If false, values in the buffer will be ignored
+   *                  if the key is already present.
+   */
+  static void readINITree(const char* data, std::size_t size, ConfigTree& pt,
+                          const std::string& srcname = "buffer",
+                          bool overwrite = true)
+  {
+    readINIBuffer(data, size, pt, srcname, overwrite);
   }
 
 
   /** \brief parse file
    *
    * Parses file with given name and build hierarchical config structure.
+   * The file is memory mapped (where supported) and parsed in place.
    *
    * \param file filename
    * \param[out] pt   The parameter tree to store the config structure.
@@ -204,16 +222,279 @@ public :
    */
   static void readINITree(std::string file, ConfigTree& pt, bool overwrite = true)
   {
-    std::ifstream in(file.c_str());
+    MappedFile in(file);
+    readINIBuffer(in.data(), in.size(), pt, "file '" + file + "'", overwrite, file);
+  }
+
+
+  /** \brief parse C++ stream, counting and timing the parse
+   *
+   * Same result as readINITree(std::istream&, ConfigTree&, const
+   * std::string, bool); adds the counts and timings of the parse to stats.
+   */
+  static void readINITree(std::istream& in, ConfigTree& pt, ParseStats& stats,
+                          const std::string& srcname = "stream",
+                          bool overwrite = true)
+  {
+    readStream(in, pt, srcname, overwrite, &stats);
+  }
+
+
+  /** \brief parse character buffer, counting and timing the parse
+   *
+   * Same result as readINITree(const char*, std::size_t, ConfigTree&,
+   * const std::string&, bool); adds the counts and timings of the parse
+   * to stats.
+   */
+  static void readINITree(const char* data, std::size_t size, ConfigTree& pt,
+                          ParseStats& stats, const std::string& srcname = "buffer",
+                          bool overwrite = true)
+  {
+    stats.start();
+    stats.input(data, size);
+    stats.lap(&ParseStats::readTime);
+    readINIBuffer(data, size, pt, srcname, overwrite, std::string(), nullptr, &stats);
+    stats.stop();
+  }
+
+
+  /** \brief parse file, counting and timing the parse
+   *
+   * Same result as readINITree(std::string, ConfigTree&, bool); adds the
+   * counts and timings of the parse to stats. Reading includes touching
+   * every page of the mapped file.
+   */
+  static void readINITree(std::string file, ConfigTree& pt, ParseStats& stats,
+                          bool overwrite = true)
+  {
+    stats.start();
+    MappedFile in(file);
+    stats.input(in.data(), in.size());
+    stats.lap(&ParseStats::readTime);
+    readINIBuffer(in.data(), in.size(), pt, "file '" + file + "'", overwrite, file,
+                  nullptr, &stats);
+    stats.stop();
+  }
+
+
+  /** \brief parse file, sharing included files with other parses
+   *
+   * Same result as readINITree(std::string, ConfigTree&, bool). Files
+   * included directly or indirectly are taken from fragments, and added
+   * to it when they are parsed.
+   *
+   * \param file filename
+   * \param[out] pt   The parameter tree to store the config structure.
+   * \param fragments The parsed include files.
+   * \param overwrite Whether to overwrite already existing values.
+   */
+  static void readINITree(std::string file, ConfigTree& pt, FragmentCache& fragments,
+                          bool overwrite = true)
+  {
+    MappedFile in(file);
+    readINIBuffer(in.data(), in.size(), pt, "file '" + file + "'", overwrite,
+                  file, &fragments);
+  }
+
+
+  /** \brief parse file that may be compressed
+   *
+   * Same result as readINITree(std::string, ConfigTree&, bool) for the
+   * decompressed contents of the file. Files compressed with gzip or zstd
+   * are decompressed chunk by chunk while they are parsed, so the memory
+   * used does not depend on the size of the file; other files are read as
+   * they are. See CompressedFile for the formats supported by a build.
+   *
+   * \param file filename
+   * \param[out] pt   The parameter tree to store the config structure.
+   * \param overwrite Whether to overwrite already existing values.
+   * \throw std::ifstream::failure if the file cannot be opened
+   * \throw std::range_error if the file is corrupt or compressed in an
+   *        unsupported format
+   */
+  static void readCompressedINITree(std::string file, ConfigTree& pt, bool overwrite = true)
+  {
+    CompressedFile in(file);
+    IncrementalINIParser parser(pt, "file '" + file + "'", overwrite, file);
+    std::vector<char> buffer(CompressedFile::chunkSize);
+    std::size_t size;
+    while ((size = in.read(buffer.data(), buffer.size())) > 0)
+      parser.feed(buffer.data(), size);
+    parser.finish();
+  }
+
+
+  /** \brief parse given file and insert result into ConfigTree, using a
+   *         cache of parsed files
+   *
+   * Same result as readINITree(std::string, ConfigTree&, bool). If cache
+   * holds the tree of the file contents, the file is not parsed. Otherwise
+   * the tree is parsed and stored in cache, unless the file includes
+   * other files.
+   *
+   * \param file The name of the file to parse
+   * \param pt   The parameter tree to store the config structure.
+   * \param cache The cache to look up and store the parsed tree.
+   * \param overwrite Whether to overwrite already existing values.
+   */
+  static void readINITree(std::string file, ConfigTree& pt, ParseCache& cache,
+                          bool overwrite = true)
+  {
+    MappedFile in(file);
+    if (cache.load(in.data(), in.size(), pt, overwrite))
+      return;
+    ConfigTree parsed;
+    parsed.setLocationTracking(pt.locationTracking());
+    // the contents of included files are not part of the key
+    if (readINIBuffer(in.data(), in.size(), parsed, "file '" + file + "'", true, file) == 0)
+      cache.store(in.data(), in.size(), parsed);
+    pt.merge(std::move(parsed), overwrite);
+  }
+
+
+  /** \brief parse character buffer on several threads
+   *
+   * Splits the buffer at line boundaries into one chunk per thread,
+   * parses the chunks concurrently into partial trees and merges those
+   * in order. The result is identical to readINITree(const char*,
+   * std::size_t, ConfigTree&, const std::string&, bool): quoted values
+   * crossing a chunk boundary, section prefixes carried over from
+   * earlier chunks and the order of keys are handled as in a sequential
+   * parse. If a chunk runs into a duplicate key or a value/subtree
+   * conflict the buffer is parsed sequentially, to report the same
+   * error and leave pt in the same state. Buffers with includes are
+   * parsed sequentially as well.
+   *
+   * \param data    Start of the buffer to parse
+   * \param size    Number of characters in the buffer
+   * \param[out] pt      The parameter tree to store the config structure.
+   * \param srcname Name of the configuration source for error
+   *                messages.
+   * \param overwrite Whether to overwrite already existing values.
+   * \param threads Number of threads, 0 picks one per core but at most
+   *                one per MB of input.
+   */
+  static void readINITreeParallel(const char* data, std::size_t size,
+                                  ConfigTree& pt,
+                                  const std::string& srcname = "buffer",
+                                  bool overwrite = true,
+                                  unsigned int threads = 0)
+  {
+    readINIParallel(data, size, pt, srcname, overwrite, threads, std::string());
+  }
+
+  /** \brief parse file on several threads
+   *
+   * Parses file with given name like readINITree(std::string,
+   * ConfigTree&, bool), using readINITreeParallel() on the mapped file.
+   *
+   * \param file filename
+   * \param[out] pt   The parameter tree to store the config structure.
+   * \param overwrite Whether to overwrite already existing values.
+   * \param threads Number of threads, 0 picks one per core but at most
+   *                one per MB of input.
+   */
+  static void readINITreeParallel(const std::string& file, ConfigTree& pt,
+                                  bool overwrite = true,
+                                  unsigned int threads = 0)
+  {
+    MappedFile in(file);
+    readINIParallel(in.data(), in.size(), pt, "file '" + file + "'",
+                    overwrite, threads, file);
+  }
+
+
+  /** \brief parse several files concurrently
+   *
+   * Reads and parses the files concurrently into private trees, then
+   * merges these into pt in the order of files. The result equals
+   * calling readINITree(files[i], pt, overwrite) for one file after the
+   * other: with overwrite later files take precedence, without it
+   * earlier ones do.
+   *
+   * If files fail to open or parse, pt receives the files before the
+   * first failing one, as in the sequential chain, and a
+   * std::range_error listing the error of every failing file is thrown.
+   *
+   * \param files     filenames, in order of precedence
+   * \param[out] pt   The parameter tree to store the config structure.
+   * \param overwrite Whether later files overwrite values of earlier
+   *                  ones and values already present in pt.
+   * \param threads   Number of threads, 0 picks one per core.
+   */
+  static void readINITrees(const std::vector<std::string>& files,
+                           ConfigTree& pt, bool overwrite = true,
+                           unsigned int threads = 0)
+  {
+    FragmentCache fragments;
+    readINITrees(files, pt, fragments, overwrite, threads);
+  }
+
+
+  /** \brief parse several files concurrently, sharing included files
+   *         with other parses
+   *
+   * Same result as readINITrees(const std::vector<std::string>&,
+   * ConfigTree&, bool, unsigned int). Files included directly or
+   * indirectly are taken from fragments, and added to it when they are
+   * parsed.
+   *
+   * \param files     filenames, in order of precedence
+   * \param[out] pt   The parameter tree to store the config structure.
+   * \param fragments The parsed include files.
+   * \param overwrite Whether later files overwrite values of earlier
+   *                  ones and values already present in pt.
+   * \param threads   Number of threads, 0 picks one per core.
+   */
+  static void readINITrees(const std::vector<std::string>& files,
+                           ConfigTree& pt, FragmentCache& fragments,
+                           bool overwrite = true, unsigned int threads = 0)
+  {
+    std::vector<ConfigTree> trees(files.size());
+    for (std::size_t i = 0; i < trees.size(); ++i)
+      trees[i].setLocationTracking(pt.locationTracking());
+    std::vector<std::string> errors(files.size());
+    std::atomic<std::size_t> next(0);
+    auto work = [&]() {
+      for (std::size_t i = next++; i < files.size(); i = next++)
+        try
+        {
+          readINITree(files[i], trees[i], fragments, true);
+        }
+        catch (const std::exception& e)
+        {
+          errors[i] = e.what();
+        }
+    };
+
+    if (threads == 0)
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<std::size_t>(threads, files.size());
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threads; ++i)
+      workers.push_back(std::thread(work));
+    work();
+    for (std::size_t i = 0; i < workers.size(); ++i)
+      workers[i].join();
 
-    if (not in)
+    std::ostringstream message;
+    for (std::size_t i = 0; i < files.size(); ++i)
+      if (errors[i] not_eq "")
+        message << "\n" << errors[i];
+    for (std::size_t i = 0; i < files.size() and errors[i] == ""; ++i)
     {
-      std::ostringstream message;
-      message << "Could not open configuration file " << file;
-      throw std::ifstream::failure(message.str());
+      std::string conflict;
+      if (pt.mergeable(trees[i], false, conflict))
+      {
+        pt.addSources(trees[i]);
+        pt.mergeInto(trees[i], overwrite);
+      }
+      else
+        // reproduce the sequential state and error
+        readINITree(files[i], pt, fragments, overwrite);
     }
-
-    readINITree(in, pt, "file '" + file + "'", overwrite);
+    if (message.str() not_eq "")
+      throw std::range_error("Errors reading configuration files:" + message.str());
   }
 
   //@}
@@ -231,22 +512,117 @@ public :
    */
   static void readOptions(int argc, char* argv [], ConfigTree& pt)
   {
-    for(int i=1; i<argc; i++)
+    readOptions(argc, argv, pt, nullptr);
+  }
+
+  /** \brief read command line options, counting and timing the parse
+   *
+   * Same result as readOptions(int, char*[], ConfigTree&); adds the
+   * counts and timings of the parse to stats.
+   */
+  static void readOptions(int argc, char* argv [], ConfigTree& pt, ParseStats& stats)
+  {
+    readOptions(argc, argv, pt, &stats);
+  }
+
+  /** \brief Specification of the options read by readNamedOptions()
+   *
+   * Built once and reused for every command line read. Keywords are
+   * looked up in a hash table, so a command line is read in time linear
+   * in its length, however many options there are. The help text is
+   * only generated when it is shown, i.e. for -h, --help and errors.
+   *
+   * Unnamed parameters are assigned to the options in the order they
+   * were added, skipping the ones already given by name.
+   */
+  class OptionSpec
+  {
+  public:
+
+    /** \brief an empty specification
+     *
+     * \param allow_more allow more options than the ones added
+     * \param overwrite  allow to overwrite existing options
+     */
+    explicit OptionSpec(bool allow_more = true, bool overwrite = true)
+      : allowMore_(allow_more), overwrite_(overwrite)
+    {}
+
+    /** \brief add an option
+     *
+     * Values of the option must parse as a T, like ConfigTree::get<T>()
+     * does; the value is stored as given.
+     *
+     * \param keyword  name of the option
+     * \param required whether the option must be given
+     * \param help     description for the help text, none if empty
+     */
+    template<class T = std::string>
+    OptionSpec& add(const std::string& keyword, bool required = true,
+                    const std::string& help = std::string())
     {
-      if ((argv[i][0]=='-') and (argv[i][1] not_eq '\000'))
-      {
-        if(argv[i+1] == nullptr)
-        {
-          std::ostringstream message;
-          message << "last option on command line (" << argv[i]
-                  << ") does not have an argument";
-          throw std::range_error(message.str());
-        }
-        pt[argv[i]+1] = argv[i+1];
-        ++i; // skip over option argument
-      }
+      Option option = {keyword, help, required, &check<T>};
+      options_.push_back(option);
+      index_.insert(std::make_pair(keyword, options_.size() - 1));
+      return *this;
+    }
+
+    /** \brief number of options added */
+    std::size_t size() const
+    {
+      return options_.size();
+    }
+
+    /** \brief help text for the program with the given name
+     *
+     * Lists required options as [keyword] and optional ones as
+     * <keyword>, followed by the help strings given.
+     */
+    std::string help(const std::string& progname) const
+    {
+      std::string helpstr = "Usage: " + progname;
+      for (std::size_t i = 0; i < options_.size(); ++i)
+        helpstr += options_[i].required
+          ? " [" + options_[i].keyword + "]" : " <" + options_[i].keyword + ">";
+      helpstr += "\n"
+        "Options:\n"
+        "-h / --help: this help\n";
+      for (std::size_t i = 0; i < options_.size(); ++i)
+        if (not options_[i].help.empty())
+          helpstr += "-" + options_[i].keyword + ":\t" + options_[i].help + "\n";
+      return helpstr;
     }
-  }
+
+  private:
+    friend class ConfigTreeParser;
+
+    struct Option
+    {
+      std::string keyword;
+      std::string help;
+      bool required;
+      // throws std::range_error if a value does not parse
+      void (*check)(const std::string&);
+    };
+
+    template<class T>
+    static void check(const std::string& value)
+    {
+      ConfigTree::Parser<T>::parse(value);
+    }
+
+    // index of the option with the given keyword, or size()
+    std::size_t find(const std::string& keyword) const
+    {
+      std::unordered_map<std::string, std::size_t>::const_iterator it = index_.find(keyword);
+      return it == index_.end() ? options_.size() : it->second;
+    }
+
+    std::vector<Option> options_;
+    std::unordered_map<std::string, std::size_t> index_;
+    bool allowMore_;
+    bool overwrite_;
+  };
 
   /**
    * \brief read [named] command line options and build hierarchical ConfigTree structure
@@ -273,104 +649,1141 @@ public :
                                bool overwrite = true,
                                std::vector<std::string> help = std::vector<std::string>())
   {
-    std::string helpstr = generateHelpString(argv[0], keywords, required, help);
-    std::vector<bool> done(keywords.size(),false);
-    std::size_t current = 0;
+    readNamedOptions(argc, argv, pt, optionSpec(keywords, required, allow_more, overwrite, help),
+                     nullptr);
+  }
 
-    for (std::size_t i=1; i<std::size_t(argc); i++)
+  /** \brief read [named] command line options, counting and timing the parse
+   *
+   * Same result as readNamedOptions(int, char*[], ConfigTree&,
+   * std::vector<std::string>, unsigned int, bool, bool,
+   * std::vector<std::string>); adds the counts and timings of the parse
+   * to stats.
+   */
+  static void readNamedOptions(int argc, char* argv[],
+                               ConfigTree& pt, ParseStats& stats,
+                               std::vector<std::string> keywords,
+                               unsigned int required = std::numeric_limits<unsigned int>::max(),
+                               bool allow_more = true,
+                               bool overwrite = true,
+                               std::vector<std::string> help = std::vector<std::string>())
+  {
+    readNamedOptions(argc, argv, pt, optionSpec(keywords, required, allow_more, overwrite, help),
+                     &stats);
+  }
+
+  /** \brief read [named] command line options as specified by spec
+   *
+   * Like readNamedOptions(int, char*[], ConfigTree&,
+   * std::vector<std::string>, unsigned int, bool, bool,
+   * std::vector<std::string>), with the options, and whether they are
+   * required, given by spec. Values of typed options are checked.
+   *
+   * \param argc arg count
+   * \param argv arg values
+   * \param[out] pt   The parameter tree to store the config structure.
+   * \param spec the options
+   * \throw std::invalid_argument with the help text for -h and --help
+   * \throw std::range_error for invalid command lines
+   */
+  static void readNamedOptions(int argc, char* argv[], ConfigTree& pt, const OptionSpec& spec)
+  {
+    readNamedOptions(argc, argv, pt, spec, nullptr);
+  }
+
+  /** \brief read [named] command line options as specified by spec,
+   *         counting and timing the parse
+   */
+  static void readNamedOptions(int argc, char* argv[], ConfigTree& pt, ParseStats& stats,
+                               const OptionSpec& spec)
+  {
+    readNamedOptions(argc, argv, pt, spec, &stats);
+  }
+
+private:
+
+  // readOptions(), measuring the parse if stats is given
+  static void readOptions(int argc, char* argv [], ConfigTree& pt, ParseStats* stats)
+  {
+    if (stats)
     {
-      std::string opt = argv[i];
-      // check for help
-      if (opt == "-h" or opt == "--help")
-        throw std::invalid_argument(helpstr);
-      // is this a named parameter?
-      if (opt.substr(0,2) == "--")
+      stats->start();
+      for (int i = 1; i < argc; ++i)
+        stats->bytes += std::strlen(argv[i]);
+    }
+    for(int i=1; i<argc; i++)
+    {
+      if ((argv[i][0]=='-') and (argv[i][1] not_eq '\000'))
       {
-        size_t pos = opt.find('=',2);
-        if (pos == std::string::npos)
-        {
-          std::ostringstream message;
-          message << "value missing for parameter " << opt << "\n" << helpstr;
-          throw std::range_error(message.str());
-        }
-        std::string key = opt.substr(2,pos-2);
-        std::string value = opt.substr(pos+1,opt.size()-pos-1);
-        auto it = std::find(keywords.begin(), keywords.end(), key);
-        // is this param in the keywords?
-        if (not allow_more and it == keywords.end())
+        if(argv[i+1] == nullptr)
         {
           std::ostringstream message;
-          message << "unknown parameter " << key << "\n" << helpstr;
+          message << "last option on command line (" << argv[i]
+                  << ") does not have an argument";
           throw std::range_error(message.str());
         }
-        // do we overwrite an existing entry?
-        if (not overwrite and pt[key] not_eq "")
+        if (stats)
         {
-          std::ostringstream message;
-          message << "parameter " << key << " already specified" << "\n" << helpstr;
-          throw std::range_error(message.str());
+          stats->lap(&ParseStats::scanTime);
+          ++stats->keys;
         }
-        pt[key] = value;
-        if(it not_eq keywords.end())
-          done[std::distance(keywords.begin(),it)] = true; // mark key as stored
-      }
-      else {
-        // map to the next keyword in the list
-      while(current < done.size() and done[current]) ++current;
-      // are there keywords left?
-      if (current >= done.size())
-      {
-        std::ostringstream message;
-        message << "superfluous unnamed parameter" << "\n" << helpstr;
-        throw std::range_error(message.str());
-      }
-      // do we overwrite an existing entry?
-      if (not overwrite and pt[keywords[current]] not_eq "")
-      {
-        std::ostringstream message;
-        message << "parameter " << keywords[current] << " already specified" << "\n" << helpstr;
-        throw std::range_error(message.str());
-      }
-      pt[keywords[current]] = opt;
-      done[current] = true; // mark key as stored
+        pt.assign(argv[i]+1, argv[i+1]);
+        if (stats)
+          stats->lap(&ParseStats::insertTime);
+        ++i; // skip over option argument
       }
     }
-    // check that we receive all required keywords
-    std::string missing = "";
-    for (unsigned int i=0; i<keywords.size(); i++)
-      if ((i < required) and not done[i]) // is this param required?
-        missing += std::string(" ") + keywords[i];
-    if (missing.size())
+    if (stats)
     {
-      std::ostringstream message;
-      message << "missing parameter(s) ... " << missing << "\n" << helpstr;
-      throw std::range_error(message.str());
+      stats->lap(&ParseStats::scanTime);
+      stats->stop();
     }
   }
 
-private:
-  static std::string generateHelpString(std::string progname, std::vector<std::string> keywords, unsigned int required, std::vector<std::string> help)
+  // the OptionSpec of the keywords, the first required of which are
+  // required
+  static OptionSpec optionSpec(const std::vector<std::string>& keywords, unsigned int required,
+                               bool allow_more, bool overwrite,
+                               const std::vector<std::string>& help)
+  {
+    OptionSpec spec(allow_more, overwrite);
+    for (std::size_t i = 0; i < keywords.size(); ++i)
+      spec.add(keywords[i], i < required, i < help.size() ? help[i] : std::string());
+    return spec;
+  }
+
+  // readNamedOptions(), measuring the parse if stats is given
+  static void readNamedOptions(int argc, char* argv[], ConfigTree& pt,
+                               const OptionSpec& spec, ParseStats* stats)
   {
-    static const char braces[] = "<>[]";
-    std::string helpstr = "";
-    helpstr = helpstr + "Usage: " + progname;
-    for (std::size_t i=0; i<keywords.size(); i++)
+    if (stats)
     {
-      bool req = (i < required);
-      helpstr = helpstr +
-        " " + braces[req*2] +
-        keywords[i] +braces[req*2+1];
+      stats->start();
+      for (int i = 1; i < argc; ++i)
+        stats->bytes += std::strlen(argv[i]);
     }
-    helpstr = helpstr + "\n"
-      "Options:\n"
-      "-h / --help: this help\n";
-    for (std::size_t i=0; i<std::min(keywords.size(),help.size()); i++)
+    const std::vector<OptionSpec::Option>& options = spec.options_;
+    std::vector<bool> done(options.size(),false);
+    std::size_t current = 0;
+
+    for (std::size_t i=1; i<std::size_t(argc); i++)
     {
-      if (help[i] not_eq "")
-        helpstr = helpstr + "-" +
-          keywords[i] + ":\t" + help[i] + "\n";
-    }
-    return helpstr;
+      const char* opt = argv[i];
+      // check for help
+      if (std::strcmp(opt, "-h") == 0 or std::strcmp(opt, "--help") == 0)
+        throw std::invalid_argument(spec.help(argv[0]));
+      std::string key;
+      const char* value = opt;
+      std::size_t index;
+      // is this a named parameter?
+      if (opt[0] == '-' and opt[1] == '-')
+      {
+        const char* pos = std::strchr(opt + 2, '=');
+        if (not pos)
+          optionError(spec, argv[0], std::string("value missing for parameter ") + opt);
+        key.assign(opt + 2, pos);
+        value = pos + 1;
+        index = spec.find(key);
+        // is this param in the keywords?
+        if (not spec.allowMore_ and index == options.size())
+          optionError(spec, argv[0], "unknown parameter " + key);
+      }
+      else
+      {
+        // map to the next keyword in the list
+        while(current < done.size() and done[current]) ++current;
+        // are there keywords left?
+        if (current >= done.size())
+          optionError(spec, argv[0], "superfluous unnamed parameter");
+        index = current;
+        key = options[index].keyword;
+      }
+      if (stats)
+        stats->lap(&ParseStats::scanTime);
+      // do we overwrite an existing entry?
+      if (not spec.overwrite_ and pt.hasKey(key) and pt[key] not_eq "")
+        optionError(spec, argv[0], "parameter " + key + " already specified");
+      if (index < options.size() and options[index].check)
+        try
+        {
+          options[index].check(value);
+        }
+        catch (const std::range_error& e)
+        {
+          optionError(spec, argv[0], "Cannot parse value \"" + std::string(value)
+                      + "\" for parameter " + key + e.what());
+        }
+      if (stats)
+      {
+        stats->lap(&ParseStats::checkTime);
+        ++stats->keys;
+      }
+      pt.assign(key, value);
+      if (stats)
+        stats->lap(&ParseStats::insertTime);
+      if (index < options.size())
+        done[index] = true; // mark key as stored
+    }
+    // check that we receive all required keywords
+    std::string missing = "";
+    for (std::size_t i=0; i<options.size(); i++)
+      if (options[i].required and not done[i]) // is this param required?
+        missing += std::string(" ") + options[i].keyword;
+    if (missing.size())
+      optionError(spec, argv[0], "missing parameter(s) ... " + missing);
+    if (stats)
+    {
+      stats->lap(&ParseStats::scanTime);
+      stats->stop();
+    }
+  }
+
+  // throw an error of readNamedOptions(), followed by the help text
+  static void optionError(const OptionSpec& spec, const char* progname, const std::string& what)
+  {
+    throw std::range_error(what + "\n" + spec.help(progname));
+  }
+
+  // line, key column and value column of each value read
+  struct Location
+  {
+    std::size_t line;
+    std::size_t column;
+    std::size_t valueColumn;
+  };
+  typedef std::unordered_map<const ConfigTree::Value*, Location> Locations;
+
+  // stores the tokens of an INI source in a tree
+  class INIBuilder
+  {
+  public:
+
+    /** file is the name of the source, if it is a file: included files
+     *  are found relative to it. Includes of the source and of the
+     *  files it includes are parsed once per fragments, or once per
+     *  builder if that is null. parent is the builder of the includer.
+     */
+    INIBuilder(ConfigTree& pt, const std::string& srcname, bool overwrite,
+               const std::string& file = std::string(),
+               FragmentCache* fragments = nullptr, const INIBuilder* parent = nullptr)
+      : pt_(pt), srcname_(srcname), overwrite_(overwrite),
+        // values read by this parse are marked with its source id,
+        // meeting such a mark again reveals a duplicate
+        source_(ConfigTree::newSource()),
+        file_(file.empty() ? file : normalize(file)),
+        fragments_(fragments), parent_(parent), includes_(0),
+        diagnostics_(parent ? parent->diagnostics_ : nullptr), locations_(nullptr),
+        stats_(parent ? parent->stats_ : nullptr),
+        track_(pt.locationTracking()), section_(nullptr)
+    {
+      if (track_)
+        pt_.addSource(source_, srcname_);
+    }
+
+    /** collect errors in diagnostics instead of throwing them, and the
+     *  line and column of every value stored in locations, if given
+     */
+    void collect(std::vector<Diagnostic>* diagnostics, Locations* locations = nullptr)
+    {
+      diagnostics_ = diagnostics;
+      locations_ = locations;
+    }
+
+    /** count and time the entries in stats, if given */
+    void measure(ParseStats* stats)
+    {
+      stats_ = stats;
+    }
+
+    void read(INIScanner& scanner)
+    {
+      // the tree may have changed since the last call
+      section_ = nullptr;
+      INIScanner::Token token;
+      if (stats_)
+      {
+        readMeasured(scanner);
+        return;
+      }
+      while (scanner.next(token))
+        apply(token);
+    }
+
+    void apply(const INIScanner::Token& token)
+    {
+      if (token.kind == INIScanner::Token::ignored)
+      {
+        if (token.key[0] == '[')
+          warn("Section header without closing bracket ignored", token.line, token.column);
+        else
+          warn("Line without assignment ignored", token.line, token.column);
+        return;
+      }
+      if (token.kind == INIScanner::Token::section)
+      {
+        prefix_.assign(token.key.data(), token.key.size());
+        if (prefix_ != "")
+          prefix_ += ".";
+        section_ = nullptr;
+        return;
+      }
+      if (token.kind == INIScanner::Token::include or token.key == "include")
+      {
+        include(token.value, token.line, token.column);
+        return;
+      }
+
+      key_.assign(token.key.data(), token.key.size());
+      if (token.unterminated)
+        warn("Quoted value of key '" + prefix_ + key_ + "' lacks its closing quote",
+             token.line, token.valueColumn);
+      store(token.value, token.line, token.column, token.valueColumn);
+    }
+
+    // number of include directives read
+    std::size_t includes() const
+    {
+      return includes_;
+    }
+
+    // name of the source in diagnostics
+    std::string source() const
+    {
+      return file_.empty() ? srcname_ : file_;
+    }
+
+  private:
+
+    // read, taking the time of each token
+    void readMeasured(INIScanner& scanner)
+    {
+      INIScanner::Token token;
+      for (;;)
+      {
+        const bool more = scanner.next(token);
+        stats_->lap(&ParseStats::scanTime);
+        if (not more)
+          break;
+        if (token.kind == INIScanner::Token::section)
+          ++stats_->sections;
+        else if (token.kind == INIScanner::Token::include or token.key == "include")
+          ++stats_->includes;
+        else if (token.kind not_eq INIScanner::Token::ignored)
+        {
+          ++stats_->keys;
+          if (std::memchr(token.value.data(), '\n', token.value.size()))
+            ++stats_->multilineValues;
+        }
+        apply(token);
+        stats_->lap(&ParseStats::insertTime);
+      }
+    }
+
+    // the tree of the current section, created with its first value
+    ConfigTree& section()
+    {
+      if (not section_)
+        section_ = prefix_.empty() ? &pt_ : &pt_.sub(prefix_.substr(0, prefix_.size() - 1));
+      return *section_;
+    }
+
+    // store value under key_ relative to the current section, found at
+    // the given line and columns. Returns the value node if the value
+    // was stored.
+    ConfigTree::Value* store(StringView value, std::size_t line, std::size_t column,
+                             std::size_t valueColumn)
+    {
+      bool created;
+      ConfigTree::Value* node;
+      if (not diagnostics_)
+        node = &section().valueNode(key_, created);
+      else
+        try
+        {
+          node = &section().valueNode(key_, created);
+        }
+        catch (const std::range_error&)
+        {
+          fail("Key '" + prefix_ + key_ + "' occurs as value and as subtree", line, column);
+          return nullptr;
+        }
+      if (stats_)
+        stats_->lap(&ParseStats::insertTime);
+      const bool duplicate = not created
+        and (reads(node->source) or (not kept_.empty() and kept_.count(node)));
+      if (stats_)
+        stats_->lap(&ParseStats::checkTime);
+      if (duplicate)
+      {
+        fail("Key '" + prefix_ + key_ + "' appears twice", line, column);
+        return nullptr;
+      }
+      if (locations_)
+      {
+        const Location location = {line, column, valueColumn};
+        (*locations_)[node] = location;
+      }
+      if (not created and not overwrite_)
+      {
+        // the value keeps its source, but counts as read
+        kept_.insert(node);
+        return nullptr;
+      }
+      node->value.assign(value.data(), value.size());
+      node->source = source_;
+      node->line = track_ ? line : 0;
+      return node;
+    }
+
+    // whether values of the given source were read by this parse
+    bool reads(unsigned int source) const
+    {
+      return source == source_
+        or std::find(included_.begin(), included_.end(), source) not_eq included_.end();
+    }
+
+    // throw an error, or collect it
+    void fail(const std::string& what, std::size_t line, std::size_t column = 0) const
+    {
+      if (diagnostics_)
+      {
+        report(Diagnostic::error, what, line, column);
+        return;
+      }
+      std::ostringstream message;
+      message << what << " in " << srcname_ << ", line " << line << " !";
+      throw std::range_error(message.str());
+    }
+
+    // collect a warning, nothing if not collecting
+    void warn(const std::string& what, std::size_t line, std::size_t column) const
+    {
+      if (diagnostics_)
+        report(Diagnostic::warning, what, line, column);
+    }
+
+    void report(Diagnostic::Severity severity, const std::string& what,
+                std::size_t line, std::size_t column) const
+    {
+      Diagnostic d = {severity, source(), line, column, what};
+      diagnostics_->push_back(d);
+    }
+
+    // store the entries of an included file below the current section
+    void include(StringView name, std::size_t line, std::size_t column)
+    {
+      if (name.empty())
+      {
+        fail("Missing file name of include", line, column);
+        return;
+      }
+      const std::string file = includePath(name);
+      std::size_t depth = 0;
+      for (const INIBuilder* b = this; b; b = b->parent_, ++depth)
+        if (b->file_ == file or depth == maxIncludeDepth)
+        {
+          fail("File '" + file + "' includes itself", line, column);
+          return;
+        }
+
+      if (not fragments_)
+      {
+        ownFragments_.reset(new FragmentCache);
+        fragments_ = ownFragments_.get();
+      }
+      std::shared_ptr<const ConfigTree> fragment;
+      {
+        std::lock_guard<std::mutex> lock(fragments_->mutex_);
+        auto it = fragments_->fragments_.find(file);
+        if (it not_eq fragments_->fragments_.end())
+          fragment = it->second;
+      }
+      if (not fragment)
+      {
+        std::shared_ptr<ConfigTree> parsed = std::make_shared<ConfigTree>();
+        // cached fragments may serve parses with and without locations
+        parsed->setLocationTracking();
+        std::unique_ptr<MappedFile> in;
+        if (stats_)
+          stats_->lap(&ParseStats::insertTime);
+        try
+        {
+          in.reset(new MappedFile(file));
+        }
+        catch (const std::ifstream::failure&)
+        {
+          if (diagnostics_)
+          {
+            fail("Could not open included file '" + file + "'", line, column);
+            return;
+          }
+          std::ostringstream message;
+          message << "Could not open included file '" << file << "' in "
+                  << srcname_ << ", line " << line << " !";
+          throw std::ifstream::failure(message.str());
+        }
+        if (stats_)
+        {
+          stats_->input(in->data(), in->size());
+          stats_->lap(&ParseStats::readTime);
+        }
+        INIScanner scanner(in->data(), in->data() + in->size());
+        scanner.reportIgnored(diagnostics_ not_eq nullptr);
+        INIBuilder builder(*parsed, "file '" + file + "'", true, file, fragments_, this);
+        builder.read(scanner);
+        fragment = parsed;
+        std::lock_guard<std::mutex> lock(fragments_->mutex_);
+        fragments_->fragments_.insert(std::make_pair(file, fragment));
+      }
+      ++includes_;
+      // the values of the fragment keep their locations, under new
+      // sources of this parse, so that including it again is a duplicate
+      SourceMap sources;
+      if (track_ and fragment->sources_)
+      {
+        ConfigTree::SourceTable renamed = *fragment->sources_;
+        for (std::size_t i = 0; i < renamed.size(); ++i)
+        {
+          sources.push_back(std::make_pair(renamed[i].first, ConfigTree::newSource()));
+          renamed[i].first = sources.back().second;
+          included_.push_back(renamed[i].first);
+        }
+        pt_.addSources(renamed);
+      }
+      storeTree(*fragment, std::string(), line, column, sources);
+    }
+
+    // the sources of a fragment and the ones of its values in this parse
+    typedef std::vector<std::pair<unsigned int, unsigned int> > SourceMap;
+
+    // store the values of tree under prefix, relative to the current section
+    void storeTree(const ConfigTree& tree, const std::string& prefix,
+                   std::size_t line, std::size_t column, const SourceMap& sources)
+    {
+      const ConfigTree::KeyVector& values = tree.getValueKeys();
+      for (std::size_t i = 0; i < values.size(); ++i)
+      {
+        const ConfigTree::Value& value = tree.values_.find(values[i])->second;
+        key_ = prefix + values[i];
+        ConfigTree::Value* node = store(value.value, line, column, column);
+        for (std::size_t j = 0; node and j < sources.size(); ++j)
+          if (sources[j].first == value.source)
+          {
+            node->source = sources[j].second;
+            node->line = value.line;
+          }
+      }
+      const ConfigTree::KeyVector& subs = tree.getSubKeys();
+      for (std::size_t i = 0; i < subs.size(); ++i)
+        storeTree(tree.sub(subs[i]), prefix + subs[i] + ".", line, column, sources);
+    }
+
+    // name of an included file, relative to the directory of the includer
+    std::string includePath(StringView name) const
+    {
+      std::string path;
+      std::string::size_type slash = file_.rfind('/');
+      if (name[0] not_eq '/' and slash not_eq std::string::npos)
+        path = file_.substr(0, slash + 1);
+      path.append(name.data(), name.size());
+      return normalize(path);
+    }
+
+    // path without "." and "dir/.." components
+    static std::string normalize(const std::string& path)
+    {
+      std::vector<std::string> parts;
+      std::istringstream in(path);
+      for (std::string part; std::getline(in, part, '/'); )
+        if (part == ".." and not parts.empty() and parts.back() not_eq "..")
+          parts.pop_back();
+        else if (not part.empty() and part not_eq ".")
+          parts.push_back(part);
+      std::string result = (path[0] == '/') ? "/" : "";
+      for (std::size_t i = 0; i < parts.size(); ++i)
+        result += (i ? "/" : "") + parts[i];
+      return result;
+    }
+
+    static const std::size_t maxIncludeDepth = 64;
+
+    ConfigTree& pt_;
+    std::string srcname_;
+    bool overwrite_;
+    unsigned int source_;
+    std::string prefix_;
+    std::string key_;
+    std::string file_;
+    FragmentCache* fragments_;
+    std::unique_ptr<FragmentCache> ownFragments_;
+    const INIBuilder* parent_;
+    std::size_t includes_;
+    std::vector<Diagnostic>* diagnostics_;
+    Locations* locations_;
+    ParseStats* stats_;
+    // whether locations are recorded
+    bool track_;
+    // tree of prefix_, null until a value of the section is stored
+    ConfigTree* section_;
+    // sources of included values
+    std::vector<unsigned int> included_;
+    // values read but not overwritten
+    std::unordered_set<const ConfigTree::Value*> kept_;
+  };
+
+  // readINITreeParallel, with includes relative to file
+  static void readINIParallel(const char* data, std::size_t size,
+                              ConfigTree& pt, const std::string& srcname,
+                              bool overwrite, unsigned int threads,
+                              const std::string& file)
+  {
+    if (threads == 0)
+    {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+      threads = std::min<std::size_t>(threads, size / (1 << 20) + 1);
+    }
+
+    // with locations, the chunks record lines under one source for the
+    // whole buffer and need to know the number of their first line
+    const bool track = pt.locationTracking();
+
+    // chunk boundaries, moved forward to the next line start
+    const char* end = data + size;
+    std::vector<INIChunk> chunks;
+    const char* begin = data;
+    std::size_t line = 1;
+    for (unsigned int i = 1; i <= threads and begin < end; ++i)
+    {
+      const char* stop = (i == threads) ? end : data + size / threads * i;
+      if (stop < begin)
+        stop = begin;
+      const void* nl = std::memchr(stop, '\n', end - stop);
+      stop = nl ? static_cast<const char*>(nl) + 1 : end;
+      chunks.push_back(INIChunk(begin, stop, line));
+      if (track)
+        line += std::count(begin, stop, '\n');
+      begin = stop;
+    }
+    if (chunks.size() < 2)
+    {
+      readINIBuffer(data, size, pt, srcname, overwrite, file);
+      return;
+    }
+
+    unsigned int source = 0;
+    if (track)
+    {
+      source = ConfigTree::newSource();
+      pt.addSource(source, srcname);
+    }
+    std::vector<std::thread> workers;
+    for (std::size_t i = 1; i < chunks.size(); ++i)
+      workers.push_back(std::thread(parseChunk, std::ref(chunks[i]), end, source));
+    parseChunk(chunks[0], end, source);
+    for (std::size_t i = 0; i < workers.size(); ++i)
+      workers[i].join();
+
+    // a quoted value running over the end of a chunk invalidates the
+    // following chunk, which then is parsed again from the right place
+    for (std::size_t i = 1; i < chunks.size(); ++i)
+      if (chunks[i-1].end > chunks[i].begin)
+      {
+        const std::size_t line = track ? chunks[i-1].line
+          + std::count(chunks[i-1].begin, chunks[i-1].end, '\n') : 1;
+        chunks[i] = INIChunk(chunks[i-1].end,
+                             std::max(chunks[i-1].end, chunks[i].stop), line);
+        parseChunk(chunks[i], end, source);
+      }
+
+    // merge the chunks in order, carrying the section prefix over
+    ConfigTree result;
+    std::string prefix;
+    bool ok = true;
+    try
+    {
+      for (std::size_t i = 0; ok and i < chunks.size(); ++i)
+      {
+        INIChunk& chunk = chunks[i];
+        ok = not chunk.failed;
+        if (ok and chunk.lead.valueKeys_.size() + chunk.lead.subKeys_.size() > 0)
+          ok = mergeUnique(prefix.empty() ? result
+                           : result.sub(prefix.substr(0, prefix.size()-1)),
+                           chunk.lead);
+        if (ok)
+          ok = mergeUnique(result, chunk.tree);
+        if (chunk.sections)
+          prefix = chunk.prefix;
+      }
+    }
+    catch (const std::range_error&)
+    {
+      ok = false;
+    }
+
+    std::string conflict;
+    if (ok and pt.mergeable(result, false, conflict))
+      pt.mergeInto(result, overwrite);
+    else
+      readINIBuffer(data, size, pt, srcname, overwrite, file);
+  }
+
+
+  // parse a stream in pieces, measuring the parse if stats is given
+  static void readStream(std::istream& in, ConfigTree& pt, const std::string& srcname,
+                         bool overwrite, ParseStats* stats)
+  {
+    IncrementalINIParser parser(pt, srcname, overwrite);
+    if (stats)
+      parser.measure(*stats);
+    char buffer[1 << 16];
+    do
+    {
+      in.read(buffer, sizeof(buffer));
+      parser.feed(buffer, in.gcount());
+    } while (in);
+    parser.finish();
+  }
+
+  // parse a buffer with the given file name, return the number of includes
+  static std::size_t readINIBuffer(const char* data, std::size_t size, ConfigTree& pt,
+                                   const std::string& srcname, bool overwrite,
+                                   const std::string& file = std::string(),
+                                   FragmentCache* fragments = nullptr,
+                                   ParseStats* stats = nullptr)
+  {
+    INIScanner scanner(data, data + size);
+    INIBuilder builder(pt, srcname, overwrite, file, fragments);
+    builder.measure(stats);
+    builder.read(scanner);
+    return builder.includes();
+  }
+
+public:
+
+  /** \brief Push parser for the INITree file format
+   *
+   * Parses INI input handed over in arbitrary pieces, e.g. as they
+   * arrive on a pipe or socket, with the same result as
+   * readINITree(std::istream&, ConfigTree&, const std::string, bool).
+   * Every entry is stored in the tree as soon as it is complete. Only an
+   * incomplete line or an open quoted value is kept between calls of
+   * feed(), so at most one logical entry is buffered.
+   */
+  class IncrementalINIParser
+  {
+  public:
+
+    /** \brief parse into pt
+     *
+     * \param[out] pt      The parameter tree to store the config structure.
+     * \param srcname Name of the configuration source for error messages.
+     * \param overwrite Whether to overwrite already existing values.
+     * \param file    Name of the file read, relative to which includes are
+     *                resolved. Empty for input that is not a file.
+     */
+    IncrementalINIParser(ConfigTree& pt, const std::string& srcname = "stream",
+                         bool overwrite = true, const std::string& file = std::string())
+      : builder_(pt, srcname, overwrite, file), stats_(nullptr),
+        quote_(0), line_(1), lineStart_(0)
+    {}
+
+    /** \brief count and time the parse in stats
+     *
+     * The parse is measured from this call to finish(). The time between
+     * calls of feed() counts as reading.
+     */
+    void measure(ParseStats& stats)
+    {
+      stats_ = &stats;
+      stats_->start();
+      builder_.measure(stats_);
+    }
+
+    /** \brief parse the next size characters of input */
+    void feed(const char* data, std::size_t size)
+    {
+      if (stats_)
+      {
+        stats_->lap(&ParseStats::readTime);
+        stats_->piece(data, size);
+      }
+      const char* pos = data;
+      const char* end = data + size;
+      // first complete the entry left over from the last call
+      while (pos not_eq end and not pending_.empty())
+      {
+        const char* nl = static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+        if (not nl)
+        {
+          pending_.append(pos, end);
+          return;
+        }
+        pending_.append(pos, nl+1);
+        pos = nl+1;
+        if (quote_ not_eq 0)
+        {
+          // an open quoted value ends with the first line ending in the
+          // quote; look for it in the input before copying it
+          if (not INIScanner::closingLine(pending_.data() + lineStart_,
+                                          pending_.data() + pending_.size(), quote_))
+          {
+            nl = INIScanner::closingLine(pos, end, quote_);
+            const char* last = nl ? nl + 1 : end;
+            pending_.append(pos, last);
+            pos = last;
+            if (not nl)
+            {
+              const char* p = pending_.data();
+              for (std::size_t i = pending_.size(); i > 0; --i)
+                if (p[i-1] == '\n')
+                {
+                  lineStart_ = i;
+                  break;
+                }
+              return;
+            }
+          }
+        }
+        pending_.erase(0, scan(pending_.data(), pending_.data() + pending_.size(), false));
+      }
+      if (not pending_.empty())
+        return;
+      pending_.assign(pos + scan(pos, end, false), end);
+    }
+
+    /** \brief parse the remaining input, after the last call of feed() */
+    void finish()
+    {
+      scan(pending_.data(), pending_.data() + pending_.size(), true);
+      pending_.clear();
+      if (stats_)
+        stats_->stop();
+    }
+
+  private:
+
+    // parse the complete entries of [b, e), return the number of
+    // characters consumed
+    std::size_t scan(const char* b, const char* e, bool final)
+    {
+      INIScanner scanner(b, e, e, line_, final);
+      builder_.read(scanner);
+      line_ = scanner.line() + 1;
+      quote_ = scanner.openQuote();
+      // the unconsumed rest starts with a complete line, if a quote is open
+      lineStart_ = 0;
+      if (quote_ not_eq 0)
+        lineStart_ = static_cast<const char*>(
+          std::memchr(scanner.position(), '\n', e - scanner.position()))
+          - scanner.position() + 1;
+      return scanner.position() - b;
+    }
+
+    INIBuilder builder_;
+    ParseStats* stats_;
+    // incomplete entry from the last call of feed()
+    std::string pending_;
+    // quote of the open value in pending_, 0 if it is an incomplete line
+    char quote_;
+    // number of the first line in pending_
+    std::size_t line_;
+    // start of the last line of pending_ not known to be complete, if quote_
+    std::size_t lineStart_;
+  };
+
+  /** \brief Checker of INI sources reporting all problems at once
+   *
+   * Parses a source like readINITree(), but instead of throwing at the
+   * first error it collects a Diagnostic with line and column for every
+   * problem and continues:
+   * - errors: keys appearing twice, keys used as value and as subtree,
+   *   includes that fail, values not matching an expect()ed type and,
+   *   if enabled by checkReferences(), references between values that
+   *   do not resolve (see ConfigTree),
+   * - warnings: lines the grammar ignores and quoted values lacking
+   *   their closing quote.
+   *
+   * A linter may be used from several threads once the expectations are
+   * set up; lint(const std::vector<std::string>&, unsigned int) checks
+   * many files concurrently.
+   */
+  class INILinter
+  {
+  public:
+
+    typedef std::vector<Diagnostic> Diagnostics;
+
+    INILinter()
+      : references_(false)
+    {}
+
+    /** \brief check the references between values, for sources read
+     *         into trees with ConfigTree::setInterpolation() enabled
+     */
+    void checkReferences(bool enable = true)
+    {
+      references_ = enable;
+    }
+
+    /** \brief expect the value of key to be readable as a T
+     *
+     * \param key      full key name
+     * \param required whether a missing key is an error
+     */
+    template<typename T>
+    void expect(const std::string& key, bool required = false)
+    {
+      Expectation e = {key, required, [](const ConfigTree& pt, const std::string& key) {
+          pt.get<T>(key);
+        }};
+      expectations_.push_back(e);
+    }
+
+    /** \brief check the file with the given name */
+    Diagnostics lint(const std::string& file) const
+    {
+      std::unique_ptr<MappedFile> in;
+      try
+      {
+        in.reset(new MappedFile(file));
+      }
+      catch (const std::exception&)
+      {
+        Diagnostic d = {Diagnostic::error, file, 0, 0, "Could not open file"};
+        return Diagnostics(1, d);
+      }
+      return lint(in->data(), in->size(), file, file);
+    }
+
+    /** \brief check the characters data[0] ... data[size-1]
+     *
+     * \param srcname name of the source in the diagnostics
+     */
+    Diagnostics lint(const char* data, std::size_t size,
+                     const std::string& srcname = "buffer") const
+    {
+      return lint(data, size, srcname, std::string());
+    }
+
+    /** \brief check several files concurrently
+     *
+     * \param files   filenames
+     * \param threads Number of threads, 0 picks one per core.
+     * \return the diagnostics of all files, in the order of files
+     */
+    Diagnostics lint(const std::vector<std::string>& files, unsigned int threads = 0) const
+    {
+      std::vector<Diagnostics> results(files.size());
+      std::atomic<std::size_t> next(0);
+      auto work = [&]() {
+        for (std::size_t i = next++; i < files.size(); i = next++)
+          results[i] = lint(files[i]);
+      };
+
+      if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      threads = std::min<std::size_t>(threads, files.size());
+      std::vector<std::thread> workers;
+      for (unsigned int i = 1; i < threads; ++i)
+        workers.push_back(std::thread(work));
+      work();
+      for (std::size_t i = 0; i < workers.size(); ++i)
+        workers[i].join();
+
+      Diagnostics all;
+      for (std::size_t i = 0; i < results.size(); ++i)
+        all.insert(all.end(), results[i].begin(), results[i].end());
+      return all;
+    }
+
+  private:
+
+    struct Expectation
+    {
+      std::string key;
+      bool required;
+      std::function<void(const ConfigTree&, const std::string&)> check;
+    };
+
+    Diagnostics lint(const char* data, std::size_t size,
+                     const std::string& srcname, const std::string& file) const
+    {
+      Diagnostics diagnostics;
+      Locations locations;
+      ConfigTree pt;
+      pt.setInterpolation(references_);
+      INIScanner scanner(data, data + size);
+      scanner.reportIgnored();
+      INIBuilder builder(pt, srcname, true, file);
+      builder.collect(&diagnostics, &locations);
+      builder.read(scanner);
+
+      // values are checked where they were read
+      const ConfigTree& result = pt;
+      const std::string source = builder.source();
+      checkValues(result, result, "", locations, source, diagnostics);
+      for (std::size_t i = 0; i < expectations_.size(); ++i)
+      {
+        const Expectation& e = expectations_[i];
+        Locations::const_iterator it = locations.find(result.findValue(e.key));
+        if (it not_eq locations.end())
+          check(result, e.key, it->second, source, diagnostics, e.check);
+        else if (e.required)
+        {
+          Diagnostic d = {Diagnostic::error, source, 0, 0, "Key '" + e.key + "' missing"};
+          diagnostics.push_back(d);
+        }
+      }
+
+      // by position, the ones of included files after those of the source
+      std::stable_sort(diagnostics.begin(), diagnostics.end(),
+                       [&source](const Diagnostic& a, const Diagnostic& b) {
+                         if ((a.source == source) not_eq (b.source == source))
+                           return a.source == source;
+                         if (a.source not_eq b.source)
+                           return a.source < b.source;
+                         return a.line < b.line or (a.line == b.line and a.column < b.column);
+                       });
+      return diagnostics;
+    }
+
+    // report the values of tree, named prefix, that are also the name of
+    // a substructure or hold references that do not resolve
+    static void checkValues(const ConfigTree& root, const ConfigTree& tree,
+                            const std::string& prefix, const Locations& locations,
+                            const std::string& source, Diagnostics& diagnostics)
+    {
+      typedef ConfigTree::ValueMap::const_iterator ValueIt;
+      for (ValueIt vit = tree.values_.begin(); vit not_eq tree.values_.end(); ++vit)
+      {
+        Locations::const_iterator location = locations.find(&vit->second);
+        if (location == locations.end())
+          continue;
+        if (tree.subs_.count(vit->first) > 0)
+        {
+          Diagnostic d = {Diagnostic::error, source, location->second.line,
+                          location->second.column,
+                          "Key '" + prefix + vit->first + "' occurs as value and as subtree"};
+          diagnostics.push_back(d);
+        }
+        else if (root.interpolation() and vit->second.value.find('$') not_eq std::string::npos)
+          check(root, prefix + vit->first, location->second, source, diagnostics,
+                [](const ConfigTree& pt, const std::string& key) { pt.get(key, ""); });
+      }
+      typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
+      for (SubIt sit = tree.subs_.begin(); sit not_eq tree.subs_.end(); ++sit)
+        checkValues(root, sit->second, prefix + sit->first + ".", locations, source, diagnostics);
+    }
+
+    template<class Check>
+    static void check(const ConfigTree& pt, const std::string& key,
+                      const Location& location, const std::string& source,
+                      Diagnostics& diagnostics, const Check& check)
+    {
+      try
+      {
+        check(pt, key);
+      }
+      catch (const std::range_error& e)
+      {
+        Diagnostic d = {Diagnostic::error, source, location.line, location.valueColumn, e.what()};
+        diagnostics.push_back(d);
+      }
+    }
+
+    std::vector<Expectation> expectations_;
+    bool references_;
+  };
+
+private:
+
+  // one chunk of a buffer parsed by readINITreeParallel
+  struct INIChunk
+  {
+    INIChunk(const char* b, const char* s, std::size_t l)
+      : begin(b), stop(s), end(s), line(l), sections(false), failed(false)
+    {}
+
+    const char* begin;  // first line of the chunk
+    const char* stop;   // lines starting here belong to the next chunk
+    const char* end;    // where parsing ended, beyond stop if a quoted
+                        // value crossed the boundary
+    std::size_t line;   // number of the first line, if tracked
+    ConfigTree lead;    // entries before the first section header,
+                        // relative to the prefix of the previous chunk
+    ConfigTree tree;    // entries after the first section header
+    std::string prefix; // prefix of the last section header
+    bool sections;      // whether the chunk has a section header
+    bool failed;        // duplicate key, value/subtree conflict or include
+  };
+
+  // parse a chunk, marking its values with source if it is not 0
+  static void parseChunk(INIChunk& chunk, const char* end, unsigned int source)
+  {
+    try
+    {
+      INIScanner scanner(chunk.begin, end, chunk.stop, chunk.line);
+      INIScanner::Token token;
+      std::string key;
+      // tree of the current section, created with its first value
+      ConfigTree* section = &chunk.lead;
+      bool resolved = true;
+      while (scanner.next(token))
+      {
+        if (token.kind == INIScanner::Token::section)
+        {
+          chunk.prefix.assign(token.key.data(), token.key.size());
+          resolved = chunk.prefix.empty();
+          section = &chunk.tree;
+          if (chunk.prefix != "")
+            chunk.prefix += ".";
+          chunk.sections = true;
+          continue;
+        }
+        // includes are left to the sequential parse
+        if (token.kind == INIScanner::Token::include or token.key == "include")
+        {
+          chunk.failed = true;
+          return;
+        }
+        if (not resolved)
+        {
+          section = &chunk.tree.sub(chunk.prefix.substr(0, chunk.prefix.size() - 1));
+          resolved = true;
+        }
+        key.assign(token.key.data(), token.key.size());
+        bool created;
+        ConfigTree::Value& node = section->valueNode(key, created);
+        // the partial trees start out empty, so any key already
+        // present is a duplicate
+        if (not created)
+        {
+          chunk.failed = true;
+          return;
+        }
+        node.value.assign(token.value.data(), token.value.size());
+        if (source)
+        {
+          node.source = source;
+          node.line = token.line;
+        }
+      }
+      chunk.end = scanner.position();
+    }
+    catch (const std::exception&)
+    {
+      chunk.failed = true;
+    }
+  }
+
+  // merge the partial tree of a chunk, false if a key occurs twice
+  static bool mergeUnique(ConfigTree& target, ConfigTree& chunk)
+  {
+    std::string conflict;
+    if (not target.mergeable(chunk, true, conflict))
+      return false;
+    target.mergeInto(chunk, true);
+    return true;
   }
 }; // end class ConfigTreeParser
 
@@ -0,0 +1,423 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef CONFIGTREEPATCH_HH
+#define CONFIGTREEPATCH_HH
+
+/** \file
+ * \brief Differences between ConfigTree objects
+ */
+
+#include <algorithm>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "configtree.hh"
+
+/** \brief Differences between the values of two ConfigTree objects
+ *
+ * diff() lists the values added, removed and changed from one tree to
+ * another, named by their full keys. apply() makes these changes to a
+ * tree, which turns the first tree into the second. Substructures only
+ * appear as part of the keys of their values: substructures without
+ * values are not compared.
+ *
+ * A patch has a compact text form, see str(), which parse() reads back.
+ */
+class ConfigTreePatch
+{
+public:
+
+  /** \brief change of a single value */
+  struct Change
+  {
+    enum Kind { added, removed, changed };
+
+    Kind kind;
+    //! full key of the value
+    std::string key;
+    //! value before the change, empty if added
+    std::string oldValue;
+    //! value after the change, empty if removed
+    std::string newValue;
+  };
+
+  typedef std::vector<Change> ChangeVector;
+
+  /** \brief the changes from a to b
+   *
+   * Both trees are traversed side by side in the order of their keys,
+   * so every key is visited once, and the changes come sorted by key
+   * within each substructure, values before substructures. A
+   * substructure shared by both trees, i.e. a and b themselves, is
+   * skipped. So is a pair of substructures whose hashes are known from
+   * earlier calls of ConfigTree::hash() and equal, once their contents
+   * are confirmed to be equal; diff() itself computes no hashes.
+   */
+  static ConfigTreePatch diff(const ConfigTree& a, const ConfigTree& b)
+  {
+    ConfigTreePatch patch;
+    std::string prefix;
+    patch.compare(a, b, prefix);
+    return patch;
+  }
+
+  /** \brief the changes */
+  const ChangeVector& changes() const
+  {
+    return changes_;
+  }
+
+  /** \brief whether the patch changes nothing */
+  bool empty() const
+  {
+    return changes_.empty();
+  }
+
+  /** \brief add a change */
+  void add(const Change& change)
+  {
+    changes_.push_back(change);
+  }
+
+  /** \brief make the changes to pt
+   *
+   * Removed and changed values must exist with their old value, added
+   * ones must not exist yet, and every key may appear once. The removals
+   * are made first, so that a key can change between value and
+   * substructure. Substructures that
+   * removals leave empty are removed, too. The tree is checked before it
+   * is modified, so a patch that does not apply leaves pt unchanged.
+   *
+   * \throw std::range_error if the patch does not apply to pt
+   */
+  void apply(ConfigTree& pt) const
+  {
+    // removals come first, they may make room for additions
+    std::set<std::string> removed, stored;
+    for (std::size_t i = 0; i < changes_.size(); ++i)
+    {
+      const Change& c = changes_[i];
+      if (removed.count(c.key) > 0 or stored.count(c.key) > 0)
+        fail("key '" + c.key + "' appears more than once");
+      if (c.kind == Change::removed)
+      {
+        check(pt, c);
+        removed.insert(c.key);
+      }
+      else
+        stored.insert(c.key);
+    }
+    for (std::size_t i = 0; i < changes_.size(); ++i)
+    {
+      const Change& c = changes_[i];
+      if (c.kind == Change::changed)
+        check(pt, c);
+      else if (c.kind == Change::added and pt.findValue(c.key))
+        fail("key '" + c.key + "' exists");
+      else if (c.kind == Change::added and not insertable(pt, c.key, removed))
+        fail("key '" + c.key + "' meets a value or substructure");
+      if (c.kind == Change::removed)
+        continue;
+      // another value stored by the patch on the way to this one
+      for (std::string::size_type dot = c.key.find('.'); dot not_eq std::string::npos;
+           dot = c.key.find('.', dot + 1))
+        if (stored.count(c.key.substr(0, dot)) > 0)
+          fail("key '" + c.key + "' meets a value or substructure");
+    }
+
+    for (std::size_t i = 0; i < changes_.size(); ++i)
+      if (changes_[i].kind == Change::removed)
+        remove(pt, changes_[i].key);
+    for (std::size_t i = 0; i < changes_.size(); ++i)
+      if (changes_[i].kind not_eq Change::removed)
+        pt.assign(changes_[i].key, changes_[i].newValue);
+  }
+
+  /** \brief the patch as text
+   *
+   * One line per change: '+', '-' or '~', the key, and the old and new
+   * values as far as they exist, separated by tabs. Backslashes, tabs and
+   * line breaks in keys and values are escaped as in C.
+   */
+  std::string str() const
+  {
+    std::string text;
+    for (std::size_t i = 0; i < changes_.size(); ++i)
+    {
+      const Change& c = changes_[i];
+      text += (c.kind == Change::added) ? '+' : (c.kind == Change::removed) ? '-' : '~';
+      escape(c.key, text);
+      if (c.kind not_eq Change::added)
+      {
+        text += '\t';
+        escape(c.oldValue, text);
+      }
+      if (c.kind not_eq Change::removed)
+      {
+        text += '\t';
+        escape(c.newValue, text);
+      }
+      text += '\n';
+    }
+    return text;
+  }
+
+  /** \brief read a patch written by str()
+   *
+   * \throw std::range_error if text is not a patch
+   */
+  static ConfigTreePatch parse(const std::string& text)
+  {
+    ConfigTreePatch patch;
+    std::size_t line = 0;
+    for (std::size_t begin = 0; begin < text.size(); )
+    {
+      ++line;
+      std::size_t end = text.find('\n', begin);
+      if (end == std::string::npos)
+        end = text.size();
+      const char kind = text[begin];
+      if (kind not_eq '+' and kind not_eq '-' and kind not_eq '~')
+        failLine("Unknown change", line);
+      std::vector<std::string> fields(1);
+      for (std::size_t p = begin + 1; p < end; ++p)
+        if (text[p] == '\t')
+          fields.push_back(std::string());
+        else if (text[p] not_eq '\\')
+          fields.back() += text[p];
+        else if (p + 1 < end and unescape(text[p + 1], fields.back()))
+          ++p;
+        else
+          failLine("Invalid escape", line);
+
+      Change c;
+      c.kind = (kind == '+') ? Change::added : (kind == '-') ? Change::removed : Change::changed;
+      if (fields.size() not_eq (c.kind == Change::changed ? 3u : 2u))
+        failLine("Wrong number of fields", line);
+      c.key = fields[0];
+      if (c.kind == Change::added)
+        c.newValue = fields[1];
+      else
+      {
+        c.oldValue = fields[1];
+        if (c.kind == Change::changed)
+          c.newValue = fields[2];
+      }
+      patch.add(c);
+      begin = end + 1;
+    }
+    return patch;
+  }
+
+private:
+
+  // add the changes from a to b, whose keys start with prefix
+  void compare(const ConfigTree& a, const ConfigTree& b, std::string& prefix)
+  {
+    if (&a == &b or (a.knownEqualHash(b) and a.equal(b)))
+      return;
+    typedef ConfigTree::ValueMap::const_iterator ValueIt;
+    ValueIt va = a.values_.begin();
+    ValueIt vb = b.values_.begin();
+    while (va not_eq a.values_.end() or vb not_eq b.values_.end())
+    {
+      const int order = (va == a.values_.end()) ? 1
+        : (vb == b.values_.end()) ? -1 : va->first.compare(vb->first);
+      if (order < 0)
+      {
+        change(Change::removed, prefix, va->first, &va->second.value, nullptr);
+        ++va;
+      }
+      else if (order > 0)
+      {
+        change(Change::added, prefix, vb->first, nullptr, &vb->second.value);
+        ++vb;
+      }
+      else
+      {
+        if (va->second.value not_eq vb->second.value)
+          change(Change::changed, prefix, va->first, &va->second.value, &vb->second.value);
+        ++va;
+        ++vb;
+      }
+    }
+
+    typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
+    SubIt sa = a.subs_.begin();
+    SubIt sb = b.subs_.begin();
+    while (sa not_eq a.subs_.end() or sb not_eq b.subs_.end())
+    {
+      const int order = (sa == a.subs_.end()) ? 1
+        : (sb == b.subs_.end()) ? -1 : sa->first.compare(sb->first);
+      const std::size_t length = prefix.size();
+      prefix += (order > 0 ? sb : sa)->first;
+      prefix += '.';
+      if (order < 0)
+        all(Change::removed, sa->second, prefix);
+      else if (order > 0)
+        all(Change::added, sb->second, prefix);
+      else
+        compare(sa->second, sb->second, prefix);
+      prefix.resize(length);
+      if (order <= 0)
+        ++sa;
+      if (order >= 0)
+        ++sb;
+    }
+  }
+
+  // add a change of kind for every value of t
+  void all(Change::Kind kind, const ConfigTree& t, std::string& prefix)
+  {
+    typedef ConfigTree::ValueMap::const_iterator ValueIt;
+    for (ValueIt v = t.values_.begin(); v not_eq t.values_.end(); ++v)
+      change(kind, prefix, v->first, kind == Change::removed ? &v->second.value : nullptr,
+             kind == Change::added ? &v->second.value : nullptr);
+    typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
+    for (SubIt s = t.subs_.begin(); s not_eq t.subs_.end(); ++s)
+    {
+      const std::size_t length = prefix.size();
+      prefix += s->first;
+      prefix += '.';
+      all(kind, s->second, prefix);
+      prefix.resize(length);
+    }
+  }
+
+  void change(Change::Kind kind, const std::string& prefix, const std::string& key,
+              const std::string* oldValue, const std::string* newValue)
+  {
+    changes_.push_back(Change());
+    Change& c = changes_.back();
+    c.kind = kind;
+    c.key.reserve(prefix.size() + key.size());
+    c.key += prefix;
+    c.key += key;
+    if (oldValue)
+      c.oldValue = *oldValue;
+    if (newValue)
+      c.newValue = *newValue;
+  }
+
+  // check that the value removed or changed by c exists in pt
+  static void check(const ConfigTree& pt, const Change& c)
+  {
+    const ConfigTree::Value* v = pt.findValue(c.key);
+    if (not v)
+      fail("key '" + c.key + "' does not exist");
+    if (v->value not_eq c.oldValue)
+      fail("key '" + c.key + "' has a different value");
+  }
+
+  // whether key can be added to pt without meeting a value on its way,
+  // or a substructure at its place, that are not removed before
+  static bool insertable(const ConfigTree& pt, const std::string& key,
+                         const std::set<std::string>& removed)
+  {
+    const ConfigTree* t = &pt;
+    std::string::size_type begin = 0;
+    for (std::string::size_type dot = key.find('.'); dot not_eq std::string::npos;
+         begin = dot + 1, dot = key.find('.', begin))
+    {
+      const std::string name = key.substr(begin, dot - begin);
+      if (t->values_.count(name) > 0)
+        return removed.count(key.substr(0, dot)) > 0;
+      std::map<std::string, ConfigTree>::const_iterator s = t->subs_.find(name);
+      if (s == t->subs_.end())
+        return true;
+      t = &s->second;
+    }
+    std::map<std::string, ConfigTree>::const_iterator s = t->subs_.find(key.substr(begin));
+    return s == t->subs_.end() or emptied(s->second, key + ".", removed);
+  }
+
+  // whether removing keys leaves t, whose keys start with prefix, empty
+  static bool emptied(const ConfigTree& t, const std::string& prefix,
+                      const std::set<std::string>& removed)
+  {
+    if (t.values_.empty() and t.subs_.empty())
+      return false;
+    typedef ConfigTree::ValueMap::const_iterator ValueIt;
+    for (ValueIt v = t.values_.begin(); v not_eq t.values_.end(); ++v)
+      if (removed.count(prefix + v->first) == 0)
+        return false;
+    typedef std::map<std::string, ConfigTree>::const_iterator SubIt;
+    for (SubIt s = t.subs_.begin(); s not_eq t.subs_.end(); ++s)
+      if (not emptied(s->second, prefix + s->first + ".", removed))
+        return false;
+    return true;
+  }
+
+  // remove the value key from t if it exists, and the substructures it
+  // leaves empty
+  static void remove(ConfigTree& t, const std::string& key)
+  {
+    std::string::size_type dot = key.find('.');
+    if (dot == std::string::npos)
+    {
+      ConfigTree::ValueMap::iterator v = t.values_.find(key);
+      if (v == t.values_.end())
+        return;
+      t.touch();
+      t.forget(v->second);
+      t.values_.erase(v);
+      t.valueKeys_.erase(std::find(t.valueKeys_.begin(), t.valueKeys_.end(), key));
+      return;
+    }
+    const std::string name = key.substr(0, dot);
+    std::map<std::string, ConfigTree>::iterator s = t.subs_.find(name);
+    if (s == t.subs_.end())
+      return;
+    remove(s->second, key.substr(dot + 1));
+    if (s->second.values_.empty() and s->second.subs_.empty())
+    {
+      t.subs_.erase(s);
+      t.subKeys_.erase(std::find(t.subKeys_.begin(), t.subKeys_.end(), name));
+    }
+  }
+
+  static void escape(const std::string& s, std::string& text)
+  {
+    for (std::size_t i = 0; i < s.size(); ++i)
+      switch (s[i])
+      {
+      case '\\': text += "\\\\"; break;
+      case '\t': text += "\\t"; break;
+      case '\n': text += "\\n"; break;
+      case '\r': text += "\\r"; break;
+      default:   text += s[i];
+      }
+  }
+
+  // append the character escaped by \c to s, false if there is none
+  static bool unescape(char c, std::string& s)
+  {
+    switch (c)
+    {
+    case '\\': s += '\\'; return true;
+    case 't':  s += '\t'; return true;
+    case 'n':  s += '\n'; return true;
+    case 'r':  s += '\r'; return true;
+    default:   return false;
+    }
+  }
+
+  static void fail(const std::string& what)
+  {
+    throw std::range_error("Patch does not apply: " + what);
+  }
+
+  static void failLine(const std::string& what, std::size_t line)
+  {
+    std::ostringstream message;
+    message << what << " in patch, line " << line << " !";
+    throw std::range_error(message.str());
+  }
+
+  ChangeVector changes_;
+};
+
+#endif // CONFIGTREEPATCH_HH
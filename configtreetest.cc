@@ -1,6 +1,26 @@
 #include <iostream>
 
 #include "configtreeparser.hh"
+#include "lazyconfigtree.hh"
+#include "binaryconfigtree.hh"
+#include "configwatcher.hh"
+#include "configtreepatch.hh"
+#include "iniwriter.hh"
+#include "jsonparser.hh"
+#include "jsonwriter.hh"
+
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif // HAVE_ZLIB
+
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif // HAVE_ZSTD
+
+#if HAVE_MMAP
+#include <sys/stat.h>
+#include <thread>
+#endif // HAVE_MMAP
 
 #if HAVE_EIGEN
 #include <Eigen/Core>
@@ -28,7 +48,7 @@
                 << " should throw " << #except << std::endl;    \
       std::abort();                                             \
     }                                                           \
-    catch(except) {}                                            \
+    catch(const except&) {}                                     \
     catch(...) {                                                \
       std::cerr << __FILE__ << ":" << __LINE__ << ": " << #expr \
                 << " should throw " << #except << std::endl;    \
@@ -252,6 +272,84 @@ void testOptionsParser()
   }
 }
 
+// the first line of the error of reading args as specified by spec,
+// empty if there is none
+std::string optionSpecError(const ConfigTreeParser::OptionSpec& spec,
+                            std::vector<std::string> args, ConfigTree& pt)
+{
+  std::vector<char*> argv;
+  for (std::size_t i = 0; i < args.size(); ++i)
+    argv.push_back(&args[i][0]);
+  argv.push_back(nullptr);
+  try
+  {
+    ConfigTreeParser::readNamedOptions(args.size(), argv.data(), pt, spec);
+  }
+  catch (const std::exception& e)
+  {
+    const std::string err = e.what();
+    return err.substr(0, err.find('\n'));
+  }
+  return "";
+}
+
+void testOptionSpec()
+{
+  ConfigTreeParser::OptionSpec spec(false);
+  spec.add<int>("steps", true, "number of steps")
+    .add("name", false)
+    .add<double>("tol", false, "tolerance")
+    .add<bool>("verbose", true);
+  check_assert(spec.size() == 4);
+
+  // one spec for several command lines
+  ConfigTree pt;
+  check_assert(optionSpecError(spec, {"prog", "5", "--tol=1e-3", "run", "yes"}, pt) == "");
+  check_assert(pt["steps"] == "5" and pt["name"] == "run" and pt.get<double>("tol") == 1e-3);
+  check_assert(pt.get<bool>("verbose"));
+  ConfigTree named;
+  check_assert(optionSpecError(spec, {"prog", "--verbose=0", "--steps=2"}, named) == "");
+  check_assert(named["steps"] == "2" and not named.hasKey("name"));
+
+  // required options need not come first
+  ConfigTree t;
+  check_assert(optionSpecError(spec, {"prog", "--steps=1", "--name=x"}, t)
+               == "missing parameter(s) ...  verbose");
+  check_assert(optionSpecError(spec, {"prog", "--steps=many", "--verbose=1"}, t)
+               .find("Cannot parse value \"many\" for parameter steps as a ") == 0);
+  check_assert(optionSpecError(spec, {"prog", "1", "x", "0.1", "yes", "more"}, t)
+               == "superfluous unnamed parameter");
+  check_assert(optionSpecError(spec, {"prog", "--other=1"}, t) == "unknown parameter other");
+
+  // the help text
+  try
+  {
+    const char* help[] = {"prog", "--help", nullptr};
+    ConfigTreeParser::readNamedOptions(2, const_cast<char**>(help), t, spec);
+    check_assert(false);
+  }
+  catch (const std::invalid_argument& e)
+  {
+    check_assert(std::string(e.what()) == spec.help("prog"));
+    check_assert(spec.help("prog").find("Usage: prog [steps] <name> <tol> [verbose]\n")
+                 == 0);
+    check_assert(spec.help("prog").find("-tol:\ttolerance\n") not_eq std::string::npos);
+  }
+  // the keyword lists keep their help text
+  try
+  {
+    const char* help[] = {"prog", "-h", nullptr};
+    ConfigTreeParser::readNamedOptions(2, const_cast<char**>(help), t, {"a", "b"}, 1, true, true,
+                                       {"first", ""});
+    check_assert(false);
+  }
+  catch (const std::invalid_argument& e)
+  {
+    check_assert(std::string(e.what())
+                 == "Usage: prog [a] <b>\nOptions:\n-h / --help: this help\n-a:\tfirst\n");
+  }
+}
+
 void testFS1527()
 {
   { // check that junk (for int) at the end is not accepted
@@ -281,20 +379,1332 @@ void testFS1523()
   check_assert(ptree.get<int>("setting") == -1);
 }
 
-void check_recursiveTreeCompare(const ConfigTree & p1,
-                                const ConfigTree & p2)
+// check the token and the compact bitset formats
+void testBitset()
+{
+  ConfigTree ptree;
+  ptree["tokens"] = "1 0 yes no 1 true 0 0";
+  ptree["hex"] = "0x35";
+  ptree["bin"] = " 0b00110101 ";
+  ptree["ranges"] = "0,2,4-5";
+  ptree["wide"] = "0x8000000000000000000000000000000F";
+  ptree["span"] = "1-126";
+  ptree["toolong"] = "0x135";
+  ptree["outside"] = "3-8";
+  ptree["junk"] = "0x3g";
+
+  check_assert(ptree.get<std::bitset<8> >("tokens") == std::bitset<8>("00110101"));
+  check_assert(ptree.get<std::bitset<8> >("hex") == std::bitset<8>("00110101"));
+  check_assert(ptree.get<std::bitset<8> >("bin") == std::bitset<8>("00110101"));
+  check_assert(ptree.get<std::bitset<8> >("ranges") == std::bitset<8>("00110101"));
+
+  std::bitset<128> wide = ptree.get<std::bitset<128> >("wide");
+  check_assert(wide.count() == 5 and wide[127] and wide[0] and wide[3]);
+  std::bitset<128> span = ptree.get<std::bitset<128> >("span");
+  check_assert(span.count() == 126 and not span[0] and not span[127]);
+
+  check_throw(ptree.get<std::bitset<8> >("toolong"), std::range_error);
+  check_throw(ptree.get<std::bitset<8> >("outside"), std::range_error);
+  check_throw(ptree.get<std::bitset<8> >("junk"), std::range_error);
+  check_throw(ptree.get<std::bitset<4> >("tokens"), std::range_error);
+
+  // a single token still is the one element of a bitset<1>
+  ptree["one"] = "yes";
+  check_assert(ptree.get<std::bitset<1> >("one").all());
+  ptree["low"] = "0b0001";
+  check_assert(ptree.get<std::bitset<1> >("low").all());
+}
+
+template<class Tree1, class Tree2>
+void check_recursiveTreeCompare(const Tree1 & p1,
+                                const Tree2 & p2)
 {
   check_assert(p1.getValueKeys() == p2.getValueKeys());
   check_assert(p1.getSubKeys() == p2.getSubKeys());
+  const ConfigTree::KeyVector valueKeys = p1.getValueKeys();
+  const ConfigTree::KeyVector subKeys = p1.getSubKeys();
   typedef ConfigTree::KeyVector::const_iterator Iterator;
-  for (Iterator it = p1.getValueKeys().begin();
-       it not_eq p1.getValueKeys().end(); ++it)
+  for (Iterator it = valueKeys.begin(); it not_eq valueKeys.end(); ++it)
     check_assert(p1[*it] == p2[*it]);
-  for (Iterator it = p1.getSubKeys().begin();
-       it not_eq p1.getSubKeys().end(); ++it)
+  for (Iterator it = subKeys.begin(); it not_eq subKeys.end(); ++it)
     check_recursiveTreeCompare(p1.sub(*it), p2.sub(*it));
 }
 
+// sample exercising the corner cases of the INI grammar
+const char* iniSample =
+  "# comment\n"
+  "a = 1\n"
+  "b = \"line one   \n"
+  "  line two  \r\n"
+  "line three\"  \n"
+  "c = 'single' # comment\n"
+  "  [ sec.sub ]  \n"
+  "x = 5 # comment\r\n"
+  "y.z = \"  spaced  \"\n"
+  "novalue\n"
+  "[ broken\n"
+  "w = 7\n"
+  "[]\n"
+  "top = \n"
+  "e = \"unterminated\n"
+  "tail\n";
+
+// check that a file is read as its contents are read from a stream
+void testINIFile()
+{
+  const char* filename = "configtreetest.ini";
+  {
+    std::ofstream out(filename);
+    out << iniSample;
+  }
+  ConfigTree fromStream;
+  std::stringstream s(iniSample);
+  ConfigTreeParser::readINITree(s, fromStream);
+  ConfigTree fromFile;
+  ConfigTreeParser::readINITree(filename, fromFile);
+  check_recursiveTreeCompare(fromStream, fromFile);
+  check_assert(fromFile["b"] == "line one   \n  line two  \r\nline three");
+  check_assert(fromFile["sec.sub.w"] == "7");
+  check_assert(fromFile["e"] == "unterminated\ntail\n");
+
+#if HAVE_MMAP
+  // a pipe has no size to map, it is read to its end
+  const char* fifoname = "configtreetest.fifo";
+  std::remove(fifoname);
+  check_assert(::mkfifo(fifoname, 0600) == 0);
+  std::thread writer([&]{ std::ofstream out(fifoname); out << iniSample; });
+  ConfigTree fromFifo;
+  ConfigTreeParser::readINITree(fifoname, fromFifo);
+  writer.join();
+  std::remove(fifoname);
+  check_recursiveTreeCompare(fromStream, fromFifo);
+#endif // HAVE_MMAP
+
+  {
+    std::ofstream out(filename);
+    out << "[a]\nb = 1\n[]\na.b = 2\n";
+  }
+  check_throw(ConfigTreeParser::readINITree(filename, fromFile), std::range_error);
+  std::remove(filename);
+  check_throw(ConfigTreeParser::readINITree(filename, fromFile), std::ifstream::failure);
+}
+
+// check long quoted values
+void testINIMultiline()
+{
+  std::string input = "before = 1\nlong = \"\n";
+  std::string expected = "\n";
+  for (int i = 0; i < 1000; ++i)
+  {
+    std::string line = "line " + std::to_string(i) + (i % 3 ? " 'x' = \"y\" z" : " # x");
+    input += line + "\n";
+    expected += line + "\n";
+  }
+  input += "end\"  \r\nafter = 2\n";
+  expected += "end";
+  ConfigTree pt;
+  ConfigTreeParser::readINITree(input.data(), input.size(), pt);
+  check_assert(pt["long"] == expected);
+  check_assert(pt["after"] == "2");
+  check_assert(pt.getValueKeys().size() == 3);
+}
+
+// check that parsing in parallel chunks gives the sequential result
+void testINIParallel()
+{
+  std::ostringstream ini;
+  ini << "top = 1\n";
+  for (int i = 0; i < 40; ++i)
+  {
+    if (i % 3 == 0)
+      ini << "[sec" << i % 7 << ".part" << i << "]\n";
+    ini << "key" << i << " = value " << i << " # comment\n"
+        << "multi" << i << " = \"first\n"
+        << "  [not.a.section]\n"
+        << "  inner = not a key\n"
+        << "last\"\n"
+        << "dotted.key" << i << " = 'x'\n";
+  }
+  const std::string input = ini.str();
+
+  ConfigTree sequential;
+  sequential["sec0.preset"] = "kept";
+  ConfigTreeParser::readINITree(input.data(), input.size(), sequential, "buffer", false);
+  for (unsigned int threads = 1; threads < 9; ++threads)
+  {
+    ConfigTree parallel;
+    parallel["sec0.preset"] = "kept";
+    ConfigTreeParser::readINITreeParallel(input.data(), input.size(), parallel,
+                                          "buffer", false, threads);
+    check_recursiveTreeCompare(sequential, parallel);
+  }
+  check_assert(sequential["sec3.part3.multi5"] == "first\n  [not.a.section]\n  inner = not a key\nlast");
+
+  // duplicates are reported as in the sequential parse
+  const std::string duplicate = input + "[sec0.part0]\nkey1 = again\n";
+  std::string sequentialError, parallelError;
+  try
+  {
+    ConfigTree pt;
+    ConfigTreeParser::readINITree(duplicate.data(), duplicate.size(), pt);
+  }
+  catch (const std::range_error& e)
+  {
+    sequentialError = e.what();
+  }
+  try
+  {
+    ConfigTree pt;
+    ConfigTreeParser::readINITreeParallel(duplicate.data(), duplicate.size(),
+                                          pt, "buffer", true, 4);
+  }
+  catch (const std::range_error& e)
+  {
+    parallelError = e.what();
+  }
+  check_assert(sequentialError not_eq "");
+  check_assert(sequentialError == parallelError);
+}
+
+// check that input fed in pieces is parsed as it is in one piece
+void testINIIncremental()
+{
+  std::vector<std::string> inputs;
+  inputs.push_back(iniSample);
+  inputs.push_back("a = \"x # c\n  y\n\"\nb = 'p\n  q'\nc = 3");
+  inputs.push_back("k = \"open\n\nstill open\n");
+  for (std::size_t i = 0; i < inputs.size(); ++i)
+  {
+    const std::string& input = inputs[i];
+    ConfigTree whole;
+    ConfigTreeParser::readINITree(input.data(), input.size(), whole);
+    for (std::size_t piece = 1; piece < 12; ++piece)
+    {
+      ConfigTree pt;
+      ConfigTreeParser::IncrementalINIParser parser(pt);
+      for (std::size_t pos = 0; pos < input.size(); pos += piece)
+        parser.feed(input.data() + pos, std::min(piece, input.size() - pos));
+      parser.feed(input.data(), 0);
+      parser.finish();
+      check_recursiveTreeCompare(whole, pt);
+    }
+  }
+
+  // entries are stored as soon as they are complete
+  ConfigTree pt;
+  ConfigTreeParser::IncrementalINIParser parser(pt);
+  const char* pieces[] = {"a = 1\nb = \"2\n", "two\"\n[s]\nc", " = 3\nc = 4\n"};
+  parser.feed(pieces[0], std::strlen(pieces[0]));
+  check_assert(pt["a"] == "1" and not pt.hasKey("b"));
+  parser.feed(pieces[1], std::strlen(pieces[1]));
+  check_assert(pt["b"] == "2\ntwo" and not pt.hasKey("s.c"));
+  check_throw(parser.feed(pieces[2], std::strlen(pieces[2])), std::range_error);
+
+  // the tree may be replaced between calls, in the middle of a section
+  ConfigTree replaced;
+  ConfigTreeParser::IncrementalINIParser sections(replaced);
+  const char* more[] = {"[s.t]\na = 1\n", "b = 2\n"};
+  sections.feed(more[0], std::strlen(more[0]));
+  replaced = ConfigTree();
+  sections.feed(more[1], std::strlen(more[1]));
+  sections.finish();
+  check_assert(replaced["s.t.b"] == "2" and not replaced.hasKey("s.t.a"));
+}
+
+// check that loading sections on demand gives the complete parse
+void testLazyConfigTree()
+{
+  const char* filename = "configtreetest.ini";
+  {
+    std::ofstream out(filename);
+    out << "[m]\nx = 1\n[]\nn.y = 2\nm.z = 3\n"
+        << "[r.d]\nq = \"[m]\nx = 2\"\n"
+        << "[m.sub]\nw = 4\n[]\n"
+        << iniSample;
+  }
+  ConfigTree preset;
+  preset["m.x"] = "0";
+  preset["r.d.p"] = "0";
+  for (int overwrite = 0; overwrite < 2; ++overwrite)
+  {
+    ConfigTree full(preset);
+    ConfigTreeParser::readINITree(filename, full, overwrite);
+    LazyConfigTree lazy(filename, preset, overwrite);
+    check_assert(lazy.loadedSections() == 0);
+    check_assert(lazy.get<int>("m.x") == (overwrite ? 1 : 0));
+    check_assert(lazy.loadedSections() == 1);
+    check_assert(lazy.sub("r").get("d.q", "") == "[m]\nx = 2");
+    check_assert(not lazy.hasKey("missing.key"));
+    check_assert(lazy.loadedSections() == 2);
+    check_recursiveTreeCompare(full, lazy.tree());
+    check_assert(lazy.loadedSections() == lazy.sections());
+  }
+
+  // a duplicate is reported once its section is reached
+  {
+    std::ofstream out(filename);
+    out << "[a]\nx = 1\n[b]\nx = 1\n[]\na.x = 2\n";
+  }
+  LazyConfigTree lazy(filename);
+  check_assert(lazy.get("b.x", "") == "1");
+  check_throw(lazy.get("a.x", ""), std::range_error);
+  std::remove(filename);
+}
+
+// check the INI -> binary -> ConfigTree round trip and lookups in place
+void testBinaryConfigTree()
+{
+  ConfigTree pt;
+  std::stringstream s(iniSample);
+  ConfigTreeParser::readINITree(s, pt);
+  pt["num.int"] = " -42 ";
+  pt["num.big"] = "123456789012345678901234567890";
+  pt["num.real"] = "2.5e-3";
+  pt["num.list"] = "1 2 3";
+  pt.sub("empty");
+
+  const char* filename = "configtreetest.bin";
+  for (int typed = 0; typed < 2; ++typed)
+  {
+    BinaryConfigTree::write(pt, filename, typed);
+    BinaryConfigTree binary(filename);
+    check_recursiveTreeCompare(pt, binary);
+    check_recursiveTreeCompare(binary, pt);
+    check_recursiveTreeCompare(pt, binary.tree());
+
+    check_assert(binary.get<int>("num.int") == -42);
+    check_assert(binary.get<double>("num.real") == pt.get<double>("num.real"));
+    check_assert(binary.get<unsigned int>("sec.sub.x") == 5);
+    check_assert((binary.get<std::array<int,3> >("num.list")[2] == 3));
+    check_assert(binary.get("sec.sub.y.z", "") == "  spaced  ");
+    check_assert(binary.get("missing", "default") == "default");
+    check_assert(binary.hasSub("sec.sub.y") and not binary.hasKey("sec.sub.y"));
+    check_assert(binary.hasSub("empty") and binary.sub("empty").getValueKeys().empty());
+    check_throw(binary.get<int>("num.big"), std::range_error);
+    check_throw(binary.get<short>("num.list"), std::range_error);
+    check_throw(binary.sub("nosuch", true), std::range_error);
+    check_throw(binary["a.b"], std::range_error);
+  }
+
+  // damaged files are rejected
+  std::string contents;
+  {
+    std::ifstream in(filename, std::ios::binary);
+    std::ostringstream out;
+    out << in.rdbuf();
+    contents = out.str();
+  }
+  std::string damaged = contents;
+  damaged[damaged.size() - 2] ^= 1;
+  check_throw(BinaryConfigTree(damaged.data(), damaged.size()), std::range_error);
+  damaged = contents;
+  damaged[8] = 2;
+  check_throw(BinaryConfigTree(damaged.data(), damaged.size()), std::range_error);
+  check_throw(BinaryConfigTree(contents.data(), contents.size() - 8), std::range_error);
+  check_throw(BinaryConfigTree(iniSample, std::strlen(iniSample)), std::range_error);
+  std::remove(filename);
+}
+
+// check that cached trees equal parsed ones
+void testParseCache()
+{
+  const char* filename = "configtreetest.ini";
+  {
+    std::ofstream out(filename);
+    out << iniSample;
+  }
+  const std::string entry = ParseCache(".").entry(iniSample, std::strlen(iniSample));
+  std::remove(entry.c_str());
+
+  ParseCache cache(".");
+  for (int overwrite = 0; overwrite < 2; ++overwrite)
+  {
+    ConfigTree parsed;
+    parsed["a"] = "preset";
+    ConfigTree cached(parsed);
+    ConfigTreeParser::readINITree(filename, parsed, overwrite);
+    ConfigTreeParser::readINITree(filename, cached, cache, overwrite);
+    check_recursiveTreeCompare(parsed, cached);
+  }
+  check_assert(cache.misses() == 1 and cache.hits() == 1 and cache.hitRate() == 0.5);
+
+  // a damaged entry is replaced
+  {
+    std::fstream damage(entry.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    damage.seekp(-2, std::ios::end);
+    damage.put('!');
+  }
+  ConfigTree pt;
+  ConfigTreeParser::readINITree(filename, pt, cache);
+  ConfigTreeParser::readINITree(filename, pt, cache);
+  check_assert(cache.misses() == 2 and cache.hits() == 2);
+  check_assert(pt["sec.sub.w"] == "7");
+  std::remove(entry.c_str());
+
+  // files with errors are not cached
+  {
+    std::ofstream out(filename);
+    out << "a = 1\na = 2\n";
+  }
+  check_throw(ConfigTreeParser::readINITree(filename, pt, cache), std::range_error);
+  check_throw(ConfigTreeParser::readINITree(filename, pt, cache), std::range_error);
+  check_assert(cache.misses() == 4 and cache.failedWrites() == 0);
+  std::remove(filename);
+}
+
+// wait up to 10 s for condition, true if it came
+template<class F>
+bool eventually(F condition)
+{
+  for (int i = 0; i < 1000 and not condition(); ++i)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  return condition();
+}
+
+// check that changed files are reloaded
+void testConfigWatcher()
+{
+  const char* filename = "configtreetest.ini";
+  {
+    std::ofstream out(filename);
+    out << "a = 1\n[s]\nb = 2\n";
+  }
+  ConfigWatcher watcher(std::vector<std::string>(1, filename), true,
+                        [](const ConfigTree& pt) {
+                          if (pt.get<int>("a") < 0)
+                            throw std::range_error("a is negative");
+                        },
+                        std::chrono::milliseconds(20));
+  std::shared_ptr<const ConfigTree> first = watcher.tree();
+  check_assert(first->get<int>("s.b") == 2);
+
+  // a burst of writes in place
+  for (int i = 2; i < 5; ++i)
+  {
+    std::ofstream out(filename);
+    out << "a = " << i << "\n";
+  }
+  check_assert(eventually([&]{ return watcher.tree()->get("a", "") == "4"; }));
+  check_assert(first->get<int>("a") == 1);
+  check_assert(watcher.reloads() >= 1 and watcher.failures() == 0);
+
+  // failures keep the old tree
+  std::size_t reloads = watcher.reloads();
+  {
+    std::ofstream out(filename);
+    out << "a = -1\n";
+  }
+  check_assert(eventually([&]{ return watcher.failures() == 1; }));
+  check_assert(watcher.lastError() == "a is negative");
+  {
+    std::ofstream out(filename);
+    out << "a = 5\na = 6\n";
+  }
+  check_assert(eventually([&]{ return watcher.failures() == 2; }));
+  check_assert(watcher.tree()->get("a", "") == "4" and watcher.reloads() == reloads);
+
+  // replacement by rename
+  {
+    std::ofstream out("configtreetest.tmp");
+    out << "a = 7\n";
+  }
+  std::rename("configtreetest.tmp", filename);
+  check_assert(eventually([&]{ return watcher.tree()->get("a", "") == "7"; }));
+  check_assert(watcher.lastLatency() > std::chrono::microseconds(0));
+
+  // included files are watched once they are included
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 1\n";
+  }
+  {
+    std::ofstream out(filename);
+    out << "a = 8\ninclude configtreetest_common.ini\n";
+  }
+  check_assert(eventually([&]{ return watcher.tree()->get("x", "") == "1"; }));
+  reloads = watcher.reloads();
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 2\n";
+  }
+  check_assert(eventually([&]{ return watcher.tree()->get("x", "") == "2"; }));
+  check_assert(watcher.reloads() > reloads and watcher.tree()->get("a", "") == "8");
+  std::remove("configtreetest_common.ini");
+  std::remove(filename);
+
+  // and when the watcher starts
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 3\n";
+  }
+  {
+    std::ofstream out(filename);
+    out << "include configtreetest_common.ini\n";
+  }
+  {
+    ConfigWatcher included(std::vector<std::string>(1, filename), true, ConfigWatcher::Validator(),
+                           std::chrono::milliseconds(20));
+    check_assert(included.tree()->get("x", "") == "3");
+    {
+      std::ofstream out("configtreetest_common.ini");
+      out << "x = 4\n";
+    }
+    check_assert(eventually([&]{ return included.reloads() == 1; }));
+    check_assert(included.tree()->get("x", "") == "4");
+  }
+  std::remove("configtreetest_common.ini");
+  std::remove(filename);
+}
+
+// check included files
+void testINIInclude()
+{
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 1\n[deep]\ny = 2\n";
+  }
+  {
+    std::ofstream out("configtreetest_main.ini");
+    out << "a = 0\ninclude configtreetest_common.ini\n"
+        << "[s]\ninclude = configtreetest_common.ini\nz = 3\n"
+        << "[t]\n  include ./configtreetest_common.ini # comment\nu = 4\n";
+  }
+  ConfigTree expected;
+  std::stringstream text("a = 0\nx = 1\ndeep.y = 2\n[s]\nx = 1\ndeep.y = 2\nz = 3\n"
+                         "[t]\nx = 1\ndeep.y = 2\nu = 4\n");
+  ConfigTreeParser::readINITree(text, expected);
+
+  ConfigTreeParser::FragmentCache fragments;
+  ConfigTree pt;
+  ConfigTreeParser::readINITree("./configtreetest_main.ini", pt, fragments);
+  check_recursiveTreeCompare(expected, pt);
+  check_assert(fragments.size() == 1);
+  ConfigTree parallel;
+  ConfigTreeParser::readINITreeParallel("configtreetest_main.ini", parallel, true, 4);
+  check_recursiveTreeCompare(expected, parallel);
+  LazyConfigTree lazy("configtreetest_main.ini");
+  check_assert(lazy.get("s.deep.y", "") == "2");
+  check_recursiveTreeCompare(expected, lazy.tree());
+
+  // errors
+  {
+    std::ofstream out("configtreetest_main.ini");
+    out << "include configtreetest_common.ini\n[deep]\ny = 3\n";
+  }
+  check_throw(ConfigTreeParser::readINITree("configtreetest_main.ini", pt), std::range_error);
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "[s]\ninclude configtreetest_main.ini\n";
+  }
+  check_throw(ConfigTreeParser::readINITree("configtreetest_main.ini", pt), std::range_error);
+  std::remove("configtreetest_common.ini");
+  check_throw(ConfigTreeParser::readINITree("configtreetest_main.ini", pt), std::ifstream::failure);
+  LazyConfigTree failing("configtreetest_main.ini");
+  check_throw(failing.get("deep.y", ""), std::ifstream::failure);
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 1\n";
+  }
+  // the failed load is not repeated
+  check_assert(failing.get("x", "none") == "none");
+  std::remove("configtreetest_common.ini");
+  std::remove("configtreetest_main.ini");
+}
+
+// check reading compressed files
+void testINICompressed()
+{
+  std::string text = "a = 1\n[s]\nb = \"two\nlines\"\ninclude configtreetest_common.ini\n";
+  for (int i = 0; i < 20000; ++i)
+    text += "k" + std::to_string(i) + " = " + std::to_string(i) + "\n";
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 1\n";
+  }
+  ConfigTree expected;
+  ConfigTreeParser::readINITree(text.data(), text.size(), expected);
+
+  // plain files are read as they are
+  {
+    std::ofstream out("configtreetest.ini");
+    out << text;
+  }
+  ConfigTree plain;
+  ConfigTreeParser::readCompressedINITree("configtreetest.ini", plain);
+  check_recursiveTreeCompare(expected, plain);
+  check_assert(CompressedFile("configtreetest.ini").format() == CompressedFile::plain);
+  std::remove("configtreetest.ini");
+
+#if HAVE_ZLIB
+  // two concatenated gzip streams, split inside the quoted value
+  const std::size_t split = text.find("two") + 2;
+  gzFile gz = gzopen("configtreetest.ini.gz", "wb");
+  gzwrite(gz, text.data(), split);
+  gzclose(gz);
+  gz = gzopen("configtreetest.ini.gz", "ab");
+  gzwrite(gz, text.data() + split, text.size() - split);
+  gzclose(gz);
+  ConfigTree unzipped;
+  unzipped.setLocationTracking();
+  ConfigTreeParser::readCompressedINITree("configtreetest.ini.gz", unzipped);
+  check_recursiveTreeCompare(expected, unzipped);
+  check_assert(unzipped.location("s.k19999").line == 20005);
+  check_assert(CompressedFile("configtreetest.ini.gz").format() == CompressedFile::gzip);
+
+  // a truncated or damaged file is an error
+  std::string data;
+  {
+    std::ifstream in("configtreetest.ini.gz", std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream out("configtreetest.ini.gz", std::ios::binary);
+    out.write(data.data(), data.size() - 10);
+  }
+  ConfigTree pt;
+  check_throw(ConfigTreeParser::readCompressedINITree("configtreetest.ini.gz", pt), std::range_error);
+  data[data.size() / 2] ^= 0x55;
+  {
+    std::ofstream out("configtreetest.ini.gz", std::ios::binary);
+    out.write(data.data(), data.size());
+  }
+  check_throw(ConfigTreeParser::readCompressedINITree("configtreetest.ini.gz", pt), std::range_error);
+#else
+  // without zlib gzip files are refused
+  {
+    std::ofstream out("configtreetest.ini.gz", std::ios::binary);
+    out << "\x1f\x8b\x08";
+  }
+  ConfigTree pt;
+  check_throw(ConfigTreeParser::readCompressedINITree("configtreetest.ini.gz", pt), std::range_error);
+#endif // HAVE_ZLIB
+  std::remove("configtreetest.ini.gz");
+
+#if HAVE_ZSTD
+  // two zstd frames, split inside the quoted value
+  std::string frames;
+  std::size_t second = 0;
+  const std::size_t middle = text.find("two") + 2;
+  const std::size_t ends[] = {0, middle, text.size()};
+  for (int i = 0; i < 2; ++i)
+  {
+    std::string frame(ZSTD_compressBound(ends[i+1] - ends[i]), '\0');
+    const std::size_t size = ZSTD_compress(&frame[0], frame.size(), text.data() + ends[i],
+                                           ends[i+1] - ends[i], 3);
+    check_assert(not ZSTD_isError(size));
+    second = frames.size();
+    frames.append(frame, 0, size);
+  }
+  {
+    std::ofstream out("configtreetest.ini.zst", std::ios::binary);
+    out.write(frames.data(), frames.size());
+  }
+  ConfigTree unzstd;
+  ConfigTreeParser::readCompressedINITree("configtreetest.ini.zst", unzstd);
+  check_recursiveTreeCompare(expected, unzstd);
+  check_assert(CompressedFile("configtreetest.ini.zst").format() == CompressedFile::zstd);
+
+  // a truncated or damaged file is an error
+  {
+    std::ofstream out("configtreetest.ini.zst", std::ios::binary);
+    out.write(frames.data(), frames.size() - 10);
+  }
+  ConfigTree truncated;
+  check_throw(ConfigTreeParser::readCompressedINITree("configtreetest.ini.zst", truncated),
+              std::range_error);
+  // frames carry no checksum, so damage the magic number of the second
+  frames[second] ^= 0x55;
+  {
+    std::ofstream out("configtreetest.ini.zst", std::ios::binary);
+    out.write(frames.data(), frames.size());
+  }
+  ConfigTree damaged;
+  check_throw(ConfigTreeParser::readCompressedINITree("configtreetest.ini.zst", damaged),
+              std::range_error);
+#else
+  // without libzstd zstd files are refused
+  {
+    std::ofstream out("configtreetest.ini.zst", std::ios::binary);
+    out << "\x28\xb5\x2f\xfd";
+  }
+  ConfigTree refused;
+  check_throw(ConfigTreeParser::readCompressedINITree("configtreetest.ini.zst", refused),
+              std::range_error);
+#endif // HAVE_ZSTD
+  std::remove("configtreetest.ini.zst");
+  std::remove("configtreetest_common.ini");
+
+  ConfigTree missing;
+  check_throw(ConfigTreeParser::readCompressedINITree("configtreetest.ini.gz", missing),
+              std::ifstream::failure);
+}
+
+// check writing trees that read back unchanged
+void testINIWriter()
+{
+  ConfigTree sample;
+  ConfigTreeParser::readINITree(iniSample, std::strlen(iniSample), sample);
+  ConfigTree pt;
+  pt["plain"] = "a = b \"c\" 'd'";
+  pt["empty"] = "";
+  pt["spaced"] = "  x\t";
+  pt["quoted"] = "\"x\"";
+  pt["quote"] = "'";
+  pt["lines"] = "one\ntwo # not a comment\n\n";
+  pt["closing"] = "one\"\ntwo\" \r\nthree";
+  pt["s.t.u"] = "1";
+  pt["s.v"] = "2";
+  pt["z.a"] = "3";
+  pt.sub("s").sub("include")["x"] = "5";
+  pt.sub("[a]")["b]"] = "6";
+  pt.sub("s").sub("")[""] = "7";
+  pt.sub("s").sub("").sub("w")["x"] = "8";
+  // only writable as dotted keys of an ancestor
+  pt.sub("s")[" a"] = "9";
+  pt.sub("s")["[a"] = "10";
+  pt.sub("z")["include"] = "11";
+  pt.sub("s").sub(" t ")["x"] = "12";
+  pt.sub("")["x"] = "13";
+
+  const ConfigTree* trees[] = {&sample, &pt};
+  for (std::size_t i = 0; i < 2; ++i)
+  {
+    const std::string text = INIWriter::str(*trees[i]);
+    ConfigTree back;
+    ConfigTreeParser::readINITree(text.data(), text.size(), back);
+    check_recursiveTreeCompare(*trees[i], back);
+    std::ostringstream out;
+    INIWriter::write(*trees[i], out);
+    check_assert(out.str() == text);
+  }
+  const std::string text = INIWriter::str(pt);
+  check_assert(text.find("plain = a = b \"c\" 'd'\n") not_eq std::string::npos);
+  check_assert(text.find("quote = \"'\"\n") not_eq std::string::npos);
+  check_assert(text.find("closing = 'one") not_eq std::string::npos);
+  check_assert(text.find("[s]\n u") == std::string::npos);
+  check_assert(text.find("[]\n.x = 13\n") not_eq std::string::npos);
+  ConfigTree hollow;
+  hollow.sub("a.b");
+  check_assert(INIWriter::str(hollow) == "");
+
+  // sorted order, through a file
+  INIWriter::write(pt, "configtreetest.ini", INIWriter::sorted);
+  ConfigTree sorted;
+  ConfigTreeParser::readINITree("configtreetest.ini", sorted);
+  std::remove("configtreetest.ini");
+  check_assert(sorted.getValueKeys().front() == "closing");
+  check_assert(sorted.getSubKeys().front() == "" and sorted.getSubKeys()[1] == "[a]" and sorted["s..w.x"] == "8");
+  check_assert(sorted["lines"] == pt["lines"] and sorted["closing"] == pt["closing"]);
+
+  // trees without INI representation
+  const char* keys[] = {"a=b", "a#b", " a", "a\n", "[a", "include"};
+  for (std::size_t i = 0; i < 6; ++i)
+  {
+    ConfigTree bad;
+    bad[keys[i]] = "1";
+    check_throw(INIWriter::str(bad), std::range_error);
+  }
+  const char* values[] = {"a # b", "a\"\n'b'\n", "#\n"};
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    ConfigTree bad;
+    bad["a"] = values[i];
+    check_throw(INIWriter::str(bad), std::range_error);
+  }
+  ConfigTree bad;
+  bad.sub("s")["a=b"] = "1";
+  check_throw(INIWriter::str(bad), std::range_error);
+}
+
+// check reading and writing JSON documents
+void testJSON()
+{
+  const char* json =
+    "\xef\xbb\xbf{\n"
+    "  \"name\": \"a \\\"quoted\\\" \\u00e9\\ud83d\\ude00\\n\\/\",\n"
+    "  \"int\": -12, \"float\": 1.5e-3, \"yes\": true, \"none\": null,\n"
+    "  \"list\": [1, 2, 3], \"empty\": [],\n"
+    "  \"solver\": {\"tol\": 0.5, \"inner\": {\"steps\": 4}},\n"
+    "  \"solver.maxit\": 100,\n"
+    "  \"hollow\": {}\n"
+    "}\n";
+  ConfigTree pt;
+  pt.setLocationTracking();
+  JSONParser::readJSONTree(json, std::strlen(json), pt);
+  check_assert(pt["name"] == "a \"quoted\" \xc3\xa9\xf0\x9f\x98\x80\n/");
+  check_assert(pt["int"] == "-12" and pt.get<double>("float") == 1.5e-3);
+  check_assert(pt.get<bool>("yes") and pt["none"] == "");
+  check_assert(pt.get<std::vector<int> >("list") == std::vector<int>({1, 2, 3}));
+  check_assert(pt["empty"] == "" and pt.hasSub("hollow"));
+  check_assert(pt["solver.tol"] == "0.5" and pt.get<int>("solver.inner.steps") == 4);
+  check_assert(pt.sub("solver").getValueKeys().back() == "maxit");
+  check_assert(pt.location("solver.maxit").source == "buffer");
+  check_assert(pt.location("solver.maxit").line == 6);
+
+  // arrays as indexed children
+  const char* arrays = "{\"a\": [1, [2, 3], {\"x\": \"y\"}], \"b\": []}";
+  ConfigTree indexed;
+  JSONParser::readJSONTree(arrays, std::strlen(arrays), indexed, JSONParser::indexed);
+  check_assert(indexed["a.0"] == "1" and indexed["a.1.1"] == "3");
+  check_assert(indexed["a.2.x"] == "y" and indexed.hasSub("b"));
+  ConfigTree joined;
+  check_throw(JSONParser::readJSONTree(arrays, std::strlen(arrays), joined), std::range_error);
+  const char* spaced[] = {"{\"a\": [\"x y\", \"z\"]}", "{\"a\": [\"\", 1]}",
+                          "{\"a\": [null]}", "{\"a\": [\"x\\ty\"]}"};
+  for (std::size_t i = 0; i < 4; ++i)
+    check_throw(JSONParser::readJSONTree(spaced[i], std::strlen(spaced[i]), joined),
+                std::range_error);
+  JSONParser::readJSONTree(spaced[0], std::strlen(spaced[0]), joined, JSONParser::indexed);
+  check_assert(joined["a.0"] == "x y" and joined["a.1"] == "z");
+
+  // duplicates, and keeping existing values
+  const char* twice = "{\"a\": 1, \"s\": {\"a\": 2}, \"s.a\": 3}";
+  check_throw(JSONParser::readJSONTree(twice, std::strlen(twice), joined), std::range_error);
+  ConfigTree kept;
+  kept["a"] = "0";
+  const char* once = "{\"a\": 1, \"b\": 2}";
+  JSONParser::readJSONTree(once, std::strlen(once), kept, JSONParser::joined, "buffer", false);
+  check_assert(kept["a"] == "0" and kept["b"] == "2");
+
+  // malformed documents
+  const char* bad[] = {"", "[]", "{", "{\"a\" 1}", "{\"a\": 1,}", "{\"a\": 01}",
+                       "{\"a\": tru}", "{\"a\": \"\\x\"}", "{\"a\": \"\\ud800\"}",
+                       "{\"a\": \"\t\"}", "{\"a\": 1} x", "{\"a\": 1, \"a\": {}}"};
+  for (std::size_t i = 0; i < 12; ++i)
+  {
+    ConfigTree t;
+    check_throw(JSONParser::readJSONTree(bad[i], std::strlen(bad[i]), t), std::range_error);
+  }
+  // a dotted key running into a value names the source and line
+  try
+  {
+    const char* into = "{\"a\": 1,\n\"a.b\": 2}";
+    ConfigTree u;
+    JSONParser::readJSONTree(into, std::strlen(into), u, JSONParser::joined, "into");
+    check_assert(false);
+  }
+  catch (const std::range_error& e)
+  {
+    check_assert(std::string(e.what()).find("in into, line 2") not_eq std::string::npos);
+  }
+  std::string deep(JSONParser::maxDepth + 1, '[');
+  deep = "{\"a\": " + deep;
+  ConfigTree t;
+  check_throw(JSONParser::readJSONTree(deep.data(), deep.size(), t, JSONParser::indexed),
+              std::range_error);
+  try
+  {
+    std::istringstream in("{\n\"a\": 1,\n\"b\": x}");
+    ConfigTree u;
+    JSONParser::readJSONTree(in, u);
+    check_assert(false);
+  }
+  catch (const std::range_error& e)
+  {
+    check_assert(std::string(e.what()).find("stream, line 3") not_eq std::string::npos);
+  }
+
+  // writing, and reading back
+  ConfigTree sample;
+  ConfigTreeParser::readINITree(iniSample, std::strlen(iniSample), sample);
+  sample["control"] = std::string("\x01\t\"\\\x7f", 5);
+  const ConfigTree* trees[] = {&sample, &pt, &indexed};
+  for (std::size_t i = 0; i < 3; ++i)
+  {
+    const std::string text = JSONWriter::str(*trees[i]);
+    ConfigTree back;
+    JSONParser::readJSONTree(text.data(), text.size(), back);
+    check_recursiveTreeCompare(*trees[i], back);
+    std::ostringstream out;
+    JSONWriter::write(*trees[i], out);
+    check_assert(out.str() == text);
+  }
+  check_assert(JSONWriter::str(sample).find("\"\\u0001\\t\\\"\\\\\x7f\"")
+               not_eq std::string::npos);
+  check_assert(JSONWriter::str(ConfigTree()) == "{}\n");
+  JSONWriter::write(pt, "configtreetest.json", JSONWriter::sorted);
+  ConfigTree sorted;
+  JSONParser::readJSONTree("configtreetest.json", sorted);
+  std::remove("configtreetest.json");
+  check_assert(sorted.getValueKeys().front() == "empty" and sorted["name"] == pt["name"]);
+}
+
+// check differences between trees
+void testPatch()
+{
+  ConfigTree a;
+  a["x"] = "1";
+  a["y"] = "2";
+  a["s.a"] = "3";
+  a["s.t.b"] = "4";
+  a["gone.c"] = "5";
+  a["kind"] = "6";
+  a["tree.z"] = "7";
+  ConfigTree b;
+  b["y"] = "2";
+  b["x"] = "one\ttwo\nthree\\";
+  b["s.a"] = "3";
+  b["s.t.b"] = "four";
+  b["new.d"] = "8";
+  b["kind.e"] = "9";
+  b["tree"] = "10";
+
+  check_assert(ConfigTreePatch::diff(a, a).empty());
+  check_assert(ConfigTreePatch::diff(a, ConfigTree(a)).empty());
+  const ConfigTreePatch patch = ConfigTreePatch::diff(a, b);
+  const ConfigTreePatch::ChangeVector& changes = patch.changes();
+  check_assert(changes.size() == 8);
+  check_assert(changes[0].kind == ConfigTreePatch::Change::removed and changes[0].key == "kind");
+  check_assert(changes[1].kind == ConfigTreePatch::Change::added and changes[1].key == "tree");
+  check_assert(changes[2].kind == ConfigTreePatch::Change::changed and changes[2].key == "x");
+  check_assert(changes[2].oldValue == "1" and changes[2].newValue == b["x"]);
+  check_assert(changes[3].key == "gone.c" and changes[4].key == "kind.e");
+  check_assert(changes[5].key == "new.d" and changes[6].key == "s.t.b");
+  check_assert(changes[7].kind == ConfigTreePatch::Change::removed and changes[7].key == "tree.z");
+
+  // the text form
+  const std::string text = patch.str();
+  check_assert(text.find("~x\t1\tone\\ttwo\\nthree\\\\\n") not_eq std::string::npos);
+  check_assert(text.find("-gone.c\t5\n") not_eq std::string::npos);
+  check_assert(ConfigTreePatch::parse(text).str() == text);
+  const char* bad[] = {"x\ta\n", "+x\n", "~x\ta\n", "-x\ta\tb\n", "+x\ta\\q\n", "\n"};
+  for (std::size_t i = 0; i < 6; ++i)
+    check_throw(ConfigTreePatch::parse(bad[i]), std::range_error);
+
+  // applying turns a into b, keys changing between value and
+  // substructure included
+  ConfigTree c(a);
+  ConfigTreePatch::parse(text).apply(c);
+  check_assert(ConfigTreePatch::diff(c, b).empty());
+  check_assert(not c.hasSub("gone") and c.hasSub("kind") and c.hasKey("tree"));
+  check_assert(ConfigTreePatch::diff(b, a).str() not_eq text);
+  ConfigTreePatch::diff(b, a).apply(c);
+  check_assert(ConfigTreePatch::diff(c, a).empty());
+
+  // a patch that does not apply leaves the tree unchanged
+  ConfigTree d(a);
+  d["x"] = "changed";
+  check_throw(patch.apply(d), std::range_error);
+  check_assert(d["x"] == "changed" and d.hasKey("kind") and d.hasSub("gone"));
+  check_throw(patch.apply(b), std::range_error);
+  ConfigTree hollow(a);
+  hollow.sub("tree.h");
+  check_throw(patch.apply(hollow), std::range_error);
+
+  // every key may appear once, and values stored must not meet
+  const char* twice[] = {"-x\t1\n-x\t1\n", "-s.a\t3\n-s.a\t3\n", "+z\t1\n~z\t1\t2\n",
+                         "~x\t1\t2\n-x\t1\n", "+z\t1\n+z.w\t2\n", "+z.w\t2\n+z\t1\n"};
+  for (std::size_t i = 0; i < 6; ++i)
+  {
+    ConfigTree e(a);
+    check_throw(ConfigTreePatch::parse(twice[i]).apply(e), std::range_error);
+    check_assert(ConfigTreePatch::diff(e, a).empty());
+  }
+}
+
+// check the hashes and comparison of trees
+void testHash()
+{
+  ConfigTree a;
+  a["x"] = "1";
+  a["solver.tol"] = "1e-8";
+  a["solver.inner.steps"] = "4";
+  a["output.dir"] = "/tmp";
+  ConfigTree b;
+  b["output.dir"] = "/tmp";
+  b["solver.inner.steps"] = "4";
+  b["solver.tol"] = "1e-8";
+  b["x"] = "1";
+  check_assert(a.hash() == b.hash() and a == b);
+  check_assert(a.hash() == 0x4319cfad73a425f9ull);
+  check_assert(ConfigTree(a) == a and a.sub("solver") == b.sub("solver"));
+  check_assert(a.sub("solver") not_eq a.sub("output"));
+
+  // changes invalidate the hashes on their path only
+  const std::uint64_t output = a.sub("output").hash();
+  const std::uint64_t solver = a.sub("solver").hash();
+  a["solver.inner.steps"] = "5";
+  check_assert(a not_eq b and a.sub("solver").hash() not_eq solver);
+  check_assert(a.sub("output").hash() == output);
+  a["solver.inner.steps"] = "4";
+  check_assert(a == b and a.sub("solver").hash() == solver);
+  a.sub("solver.hollow");
+  check_assert(a not_eq b);
+  a.sub("solver") = b.sub("solver");
+  check_assert(a == b);
+  ConfigTree c;
+  c["solver.tol.x"] = "1";
+  check_assert(c.sub("solver").hash() not_eq a.sub("solver").hash());
+
+  // changes by merges, parsers and patches
+  ConfigTree extra;
+  extra["solver.tol"] = "1e-6";
+  a.merge(extra);
+  check_assert(a not_eq b and a.sub("output").hash() == output);
+  ConfigTreePatch::diff(a, b).apply(a);
+  check_assert(a == b);
+  const char* ini = "[solver]\ntol = 1e-4\n";
+  ConfigTreeParser::readINITree(ini, std::strlen(ini), a);
+  check_assert(a not_eq b and a["solver.tol"] == "1e-4");
+  const char* json = "{\"solver\": {\"tol\": \"1e-8\"}}";
+  JSONParser::readJSONTree(json, std::strlen(json), a);
+  check_assert(a == b);
+
+  // moving out leaves an empty tree, and changes the enclosing one
+  b.hash();
+  ConfigTree moved(std::move(b.sub("solver")));
+  check_assert(b.sub("solver") == ConfigTree() and b not_eq a);
+  check_assert(moved == a.sub("solver"));
+  ConfigTree whole(std::move(a));
+  check_assert(a == ConfigTree() and whole not_eq a);
+
+  // diff() skips equal substructures with known hashes, and finds the
+  // changed ones
+  whole["output.dir"] = "/scratch";
+  const ConfigTreePatch patch = ConfigTreePatch::diff(whole, ConfigTree(whole));
+  check_assert(patch.empty());
+  ConfigTree other(whole);
+  other["solver.inner.steps"] = "6";
+  check_assert(ConfigTreePatch::diff(whole, other).changes().size() == 1);
+  whole.hash();
+  other.hash();
+  check_assert(ConfigTreePatch::diff(whole, other).changes().size() == 1);
+  check_assert(ConfigTreePatch::diff(whole, ConfigTree(whole)).empty());
+}
+
+// check the counts and timings of parses
+void testParseStats()
+{
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 1\n[deep]\ny = 2";
+  }
+  const std::string text = "a = 1\n# comment\n[s]\nb = \"two\nlines\"\n"
+    "include configtreetest_common.ini\n[t.u]\nc = 3";
+  ConfigTree expected;
+  ConfigTreeParser::readINITree(text.data(), text.size(), expected);
+
+  ParseStats stats;
+  ConfigTree pt;
+  ConfigTreeParser::readINITree(text.data(), text.size(), pt, stats);
+  check_recursiveTreeCompare(expected, pt);
+  check_assert(stats.bytes == text.size() + 18 and stats.lines == 8 + 3);
+  check_assert(stats.sections == 3 and stats.keys == 5 and stats.includes == 1);
+  check_assert(stats.multilineValues == 1);
+  check_assert(stats.readTime + stats.scanTime + stats.insertTime + stats.checkTime
+               <= stats.totalTime);
+
+  // the same counts for a stream, parses add up
+  std::stringstream in(text);
+  ConfigTree streamed;
+  ConfigTreeParser::readINITree(in, streamed, stats);
+  check_recursiveTreeCompare(expected, streamed);
+  check_assert(stats.lines == 2 * 11 and stats.keys == 10 and stats.multilineValues == 2);
+  std::remove("configtreetest_common.ini");
+
+  // the options parsers count their entries, and check duplicates
+  ParseStats options;
+  ConfigTree opt;
+  const char* args[] = {"prog", "-a", "1", "-b.c", "2", nullptr};
+  ConfigTreeParser::readOptions(5, const_cast<char**>(args), opt, options);
+  check_assert(opt["b.c"] == "2" and options.keys == 2 and options.bytes == 8);
+  const char* named[] = {"prog", "--a=3", "4", nullptr};
+  ConfigTreeParser::readNamedOptions(3, const_cast<char**>(named), opt, options,
+                                     std::vector<std::string>(1, "d"));
+  check_assert(opt["a"] == "3" and opt["d"] == "4" and options.keys == 4);
+  check_throw(ConfigTreeParser::readNamedOptions(3, const_cast<char**>(named), opt, options,
+                                                 std::vector<std::string>(1, "d"), 1, true, false),
+              std::range_error);
+}
+
+// check the sources and lines recorded for values
+void testLocations()
+{
+  {
+    std::ofstream out("configtreetest_common.ini");
+    out << "x = 1\n\n[deep]\ny = 2\n";
+  }
+  std::stringstream text("a = 1\n"
+                         "[s]\n"
+                         "# comment\n"
+                         "b = \"two\n"
+                         "lines\"\n"
+                         "c = x\n"
+                         "include configtreetest_common.ini\n");
+  ConfigTree pt;
+  pt.setLocationTracking();
+  ConfigTreeParser::readINITree(text, pt, "stream");
+  check_assert(pt.location("a").source == "stream" and pt.location("a").line == 1);
+  check_assert(pt.location("s.b").line == 4 and pt.location("s.c").line == 6);
+  check_assert(pt.location("s.x").source == "file 'configtreetest_common.ini'");
+  check_assert(pt.location("s.x").line == 1 and pt.location("s.deep.y").line == 4);
+  check_throw(pt.location("missing"), std::range_error);
+  try
+  {
+    pt.get<int>("s.c");
+    check_assert(false);
+  }
+  catch (const std::range_error& e)
+  {
+    check_assert(std::string(e.what()).find("(read from stream, line 6)") not_eq std::string::npos);
+  }
+
+  // including a file twice is still a duplicate
+  std::stringstream twice("include configtreetest_common.ini\ninclude configtreetest_common.ini\n");
+  ConfigTree dup;
+  dup.setLocationTracking();
+  check_throw(ConfigTreeParser::readINITree(twice, dup), std::range_error);
+
+  // copies and merges keep the locations, unchanged values keep theirs
+  ConfigTree sub = pt.sub("s");
+  check_assert(sub.location("deep.y").line == 4);
+  ConfigTree merged;
+  merged.merge(pt);
+  check_assert(merged.location("s.c").source == "stream");
+  std::stringstream more("a = 2\nd = 3\n");
+  merged.setLocationTracking();
+  ConfigTreeParser::readINITree(more, merged, "more", false);
+  check_assert(merged.location("a").source == "stream" and merged.location("d").source == "more");
+  // reading through operator[] keeps the location, new keys have none
+  check_assert(merged["a"] == "1");
+  check_assert(merged.location("a").source == "stream" and merged.location("a").line == 1);
+  merged["e"] = "4";
+  check_assert(merged.location("e").source == "" and merged.location("e").line == 0);
+  char prog[] = "prog", option[] = "-a", value[] = "5";
+  char* args[] = {prog, option, value};
+  ConfigTreeParser::readOptions(3, args, merged);
+  check_assert(merged["a"] == "5" and merged.location("a").source == "");
+  check_throw(merged.location("s.nosuch"), std::range_error);
+  check_throw(merged.location("nosuch.key"), std::range_error);
+
+  // parallel parses count lines across chunks
+  std::string big;
+  for (int i = 0; i < 1000; ++i)
+    big += "k" + std::to_string(i) + " = " + std::to_string(i) + "\n";
+  ConfigTree parallel;
+  parallel.setLocationTracking();
+  ConfigTreeParser::readINITreeParallel(big.data(), big.size(), parallel, "big", true, 4);
+  check_assert(parallel.location("k0").line == 1 and parallel.location("k999").line == 1000);
+
+  // without tracking no locations are known
+  ConfigTree untracked;
+  std::stringstream plain("a = 1\n");
+  ConfigTreeParser::readINITree(plain, untracked);
+  check_assert(untracked.location("a").source == "" and untracked.location("a").line == 0);
+  std::remove("configtreetest_common.ini");
+}
+
+// check that linting collects all problems with their positions
+void testINILint()
+{
+  {
+    std::ofstream out("configtreetest_lint.ini");
+    out << "n = 1\n"
+        << "n = 2\n"
+        << "[s]\n"
+        << "  x = 3\n"
+        << "  x.y = 4\n"
+        << "bad = abc\n"
+        << "path = ${root}/x\n"
+        << "[broken\n"
+        << "just words\n"
+        << "include configtreetest_missing.ini\n"
+        << "[t]\na.b = 1\na = 2\n"
+        << "q = \"open\n";
+  }
+  ConfigTreeParser::INILinter linter;
+  linter.expect<int>("n");
+  linter.expect<int>("s.bad");
+  linter.expect<double>("required.key", true);
+  linter.checkReferences();
+  ConfigTreeParser::INILinter::Diagnostics d = linter.lint("configtreetest_lint.ini");
+
+  typedef ConfigTreeParser::Diagnostic D;
+  const D::Severity E = D::error, W = D::warning;
+  const std::size_t expected[][3] = {{E, 0, 0}, {E, 2, 1}, {E, 5, 3}, {E, 6, 7}, {E, 7, 8},
+                                     {W, 8, 1}, {W, 9, 1}, {E, 10, 1}, {E, 13, 1},
+                                     {W, 14, 5}};
+  check_assert(d.size() == sizeof(expected) / sizeof(expected[0]));
+  for (std::size_t i = 0; i < d.size(); ++i)
+  {
+    check_assert(d[i].severity == expected[i][0]);
+    check_assert(d[i].line == expected[i][1]);
+    check_assert(d[i].column == expected[i][2]);
+    check_assert(d[i].source == "configtreetest_lint.ini");
+  }
+  check_assert(d[1].message == "Key 'n' appears twice");
+  check_assert(d[2].message == "Key 's.x.y' occurs as value and as subtree");
+  check_assert(d[8].message == "Key 't.a' occurs as value and as subtree");
+
+  std::vector<std::string> files(3, "configtreetest_lint.ini");
+  files[1] = "configtreetest_nofile.ini";
+  d = linter.lint(files, 2);
+  check_assert(d.size() == 21);
+  check_assert(d[10].source == "configtreetest_nofile.ini" and d[10].line == 0);
+
+  const char clean[] = "a = 1\n[b]\nc = ${a}\n";
+  check_assert(ConfigTreeParser::INILinter().lint(clean, std::strlen(clean)).empty());
+  std::remove("configtreetest_lint.ini");
+}
+
+// check references between values
+void testInterpolation()
+{
+  std::stringstream text("base = /scratch\n"
+                         "count = 4\n"
+                         "[case]\nname = ${ base }/cavity\n"
+                         "[output]\ndir = ${case.name}/run/${count}\n"
+                         "n = ${count}\nprice = $5 or $${base}\n");
+  ConfigTree pt;
+  ConfigTreeParser::readINITree(text, pt);
+  // values are read as written unless enabled
+  check_assert(pt.get("output.dir", "") == "${case.name}/run/${count}");
+  ConfigTree script;
+  script["run"] = "echo ${HOME}";
+  check_assert(script.get<std::string>("run") == "echo ${HOME}");
+
+  pt.setInterpolation();
+  check_assert(pt.get("output.dir", "") == "/scratch/cavity/run/4");
+  check_assert(pt["output.dir"] == "${case.name}/run/${count}");
+  check_assert(pt.sub("output").get<std::string>("dir") == "/scratch/cavity/run/4");
+  check_assert(pt.get<int>("output.n") == 4);
+  check_assert(pt.get("output.price", "") == "$5 or ${base}");
+
+  // changes through operator[] are seen by resolved values
+  pt["base"] = "/tmp";
+  check_assert(pt.get("output.dir", "") == "/tmp/cavity/run/4");
+  pt.sub("case")["name"] = "${base}/duct";
+  check_assert(pt.get("output.dir", "") == "/tmp/duct/run/4");
+  // through the references of references
+  pt["base"] = "/var";
+  check_assert(pt.get("output.dir", "") == "/var/duct/run/4");
+  pt["base"] = "/tmp";
+
+  // copies resolve against themselves
+  ConfigTree copy = pt;
+  copy["count"] = "5";
+  check_assert(copy.get("output.dir", "") == "/tmp/duct/run/5");
+  check_assert(pt.get("output.dir", "") == "/tmp/duct/run/4");
+  ConfigTree merged;
+  merged["base"] = "/home";
+  merged.merge(std::move(copy), false);
+  merged.setInterpolation();
+  check_assert(merged.get("output.dir", "") == "/home/duct/run/5");
+  // a copied substructure is a root of its own
+  ConfigTree output = pt.sub("output");
+  check_assert(output.interpolation());
+  check_throw(output.get("dir", ""), std::range_error);
+  output["case.name"] = "pipe";
+  output["count"] = "2";
+  check_assert(output.get("dir", "") == "pipe/run/2");
+
+  pt.sub("output").setInterpolation(false);
+  check_assert(not pt.interpolation());
+  check_assert(pt.get("output.n", "") == "${count}");
+  pt.setInterpolation();
+
+  // errors
+  pt["a"] = "${b}";
+  pt["b"] = "x${a}";
+  check_throw(pt.get("a", ""), std::range_error);
+  try
+  {
+    pt.get<std::string>("b");
+    check_assert(false);
+  }
+  catch (const std::range_error& e)
+  {
+    check_assert(std::string(e.what()).find("b -> a -> b") not_eq std::string::npos);
+  }
+  pt["c"] = "${missing}";
+  check_throw(pt.get("c", ""), std::range_error);
+  pt["d"] = "${base";
+  check_throw(pt.get("d", ""), std::range_error);
+}
+
+// check that reading files concurrently equals reading them in turn
+void testINIFiles()
+{
+  std::vector<std::string> files;
+  for (int i = 0; i < 6; ++i)
+  {
+    files.push_back("configtreetest" + std::to_string(i) + ".ini");
+    std::ofstream out(files.back().c_str());
+    out << "common = " << i << "\n"
+        << "only" << i << " = x\n"
+        << "[sec" << i % 2 << "]\n"
+        << "value = " << i << "\n";
+  }
+
+  for (int overwrite = 0; overwrite < 2; ++overwrite)
+  {
+    ConfigTree sequential, concurrent;
+    sequential["common"] = concurrent["common"] = "preset";
+    for (std::size_t i = 0; i < files.size(); ++i)
+      ConfigTreeParser::readINITree(files[i], sequential, overwrite);
+    ConfigTreeParser::readINITrees(files, concurrent, overwrite, 3);
+    check_recursiveTreeCompare(sequential, concurrent);
+  }
+
+  // every failing file is reported, pt holds the files before the first
+  {
+    std::ofstream out(files[4].c_str());
+    out << "a = 1\na = 2\n";
+  }
+  files.insert(files.begin() + 2, "configtreetest_missing.ini");
+  ConfigTree pt;
+  try
+  {
+    ConfigTreeParser::readINITrees(files, pt);
+    check_assert(false);
+  }
+  catch (const std::range_error& e)
+  {
+    std::string what = e.what();
+    check_assert(what.find("configtreetest_missing.ini") not_eq std::string::npos);
+    check_assert(what.find("configtreetest4.ini") not_eq std::string::npos);
+  }
+  check_assert(pt["common"] == "1" and not pt.hasKey("only2"));
+
+  for (std::size_t i = 0; i < files.size(); ++i)
+    std::remove(files[i].c_str());
+}
+
+// check that the vectorized delimiter classification agrees with the
+// portable one
+void testINIClassifier()
+{
+  std::string block;
+  const char alphabet[] = "ab =#[]\"'\n\t\x80\xff";
+  for (std::size_t i = 0; i < 4 * INIClassifier::blockSize; ++i)
+    block += alphabet[(i * 7 + i / 5) % (sizeof(alphabet) - 1)];
+  for (std::size_t i = 0; i < 4; ++i)
+  {
+    INIClassifier::Masks simd, scalar;
+    INIClassifier::classify(block.data() + i * INIClassifier::blockSize, simd);
+    INIClassifier::classifyScalar(block.data() + i * INIClassifier::blockSize, scalar);
+    check_assert(simd.newline == scalar.newline);
+    check_assert(simd.comment == scalar.comment);
+    check_assert(simd.assign == scalar.assign);
+    check_assert(simd.quote == scalar.quote);
+    check_assert(simd.bracket == scalar.bracket);
+  }
+
+  // the cursor finds every selected delimiter, including in the tail
+  block.resize(3 * INIClassifier::blockSize + 17);
+  INIClassifier::Cursor cursor(block.data(), block.data() + block.size(),
+                               INIClassifier::comment | INIClassifier::bracket);
+  const char* pos = block.data();
+  for (std::size_t i = 0; i < block.size(); ++i)
+    if (std::strchr("#[]", block[i]))
+    {
+      pos = cursor.find(pos);
+      check_assert(pos == block.data() + i);
+      ++pos;
+    }
+  check_assert(cursor.find(pos) == block.data() + block.size());
+}
+
 // test report method and read back in
 void testReport()
 {
@@ -340,10 +1750,52 @@ int main()
 
   // check the command line parser
   testOptionsParser();
+  testOptionSpec();
 
   // check report
   testReport();
 
+  // check reading files
+  testINIFile();
+  testINIClassifier();
+  testINIMultiline();
+  testINIParallel();
+  testINIIncremental();
+  testLazyConfigTree();
+  testBinaryConfigTree();
+  testParseCache();
+  testConfigWatcher();
+  testINIInclude();
+  testINIFiles();
+  testINICompressed();
+
+  // check statistics of parses
+  testParseStats();
+
+  // check writing INI files
+  testINIWriter();
+
+  // check reading and writing JSON documents
+  testJSON();
+
+  // check differences between trees
+  testPatch();
+
+  // check the hashes and comparison of trees
+  testHash();
+
+  // check references between values
+  testInterpolation();
+
+  // check collecting all problems of a source
+  testINILint();
+
+  // check source locations of values
+  testLocations();
+
+  // check bitset formats
+  testBitset();
+
   // check for specific bugs
   testFS1527();
   testFS1523();
@@ -0,0 +1,66 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef CONFIGTREEWRITER_HH
+#define CONFIGTREEWRITER_HH
+
+/** \file
+ * \brief Output handling shared by the writers of ConfigTree objects
+ */
+
+#include <fstream>
+#include <ostream>
+#include <string>
+
+#include "configtree.hh"
+
+/** \brief Output handling shared by INIWriter and JSONWriter
+ *
+ * A writer appends its output to a buffer, which is handed to the
+ * stream in one piece whenever it holds bufferSize bytes. Without a
+ * stream the buffer grows and takes the whole output.
+ */
+class ConfigTreeWriter
+{
+public:
+
+  /** \brief order of the keys of a substructure in the output */
+  enum Order
+  {
+    insertion, //!< the order of getValueKeys() and getSubKeys()
+    sorted     //!< sorted by name
+  };
+
+  /** \brief size of the output buffer */
+  static const std::size_t bufferSize = 1 << 20;
+
+protected:
+
+  ConfigTreeWriter(std::string& buffer, std::ostream* out, Order order)
+    : buffer_(buffer), out_(out), order_(order)
+  {}
+
+  // write pt with Writer::write() to the file with the given name
+  template<class Writer>
+  static void writeFile(const ConfigTree& pt, const std::string& file, Order order)
+  {
+    std::ofstream out(file.c_str(), std::ios::out | std::ios::binary);
+    if (not out)
+      throw std::ofstream::failure("Could not open file " + file + " for writing");
+    Writer::write(pt, out, order);
+    out.close();
+    if (not out)
+      throw std::ofstream::failure("Could not write file " + file);
+  }
+
+  void flush()
+  {
+    out_->write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+  }
+
+  std::string& buffer_;
+  std::ostream* out_;
+  Order order_;
+};
+
+#endif // CONFIGTREEWRITER_HH
@@ -0,0 +1,348 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef CONFIGWATCHER_HH
+#define CONFIGWATCHER_HH
+
+/** \file
+ * \brief Reload of configuration files on change
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "binaryconfigtree.hh"
+#include "configtree.hh"
+#include "configtreeparser.hh"
+#include "mappedfile.hh"
+
+#if HAVE_INOTIFY
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif // HAVE_INOTIFY
+
+/** \brief ConfigTree of a set of INI files, reloaded when they change
+ *
+ * The files are read with ConfigTreeParser::readINITrees(). A background
+ * thread watches them, with inotify where available and by polling
+ * their contents otherwise. Once a burst of changes has been quiet for
+ * the debounce interval, the files are parsed again and the optional
+ * validator is called on the result. A tree that parses and validates
+ * replaces the published one atomically; readers holding the old tree
+ * keep it alive and are never blocked by a reload. Failed reloads are
+ * counted and keep the old tree.
+ *
+ * The watcher observes the directories of the files, so files replaced
+ * by renaming a new version over them are seen as well. Files included
+ * by the files are watched too; their set is updated on every reload.
+ */
+class ConfigWatcher
+{
+public:
+
+  /** \brief check of a reloaded tree, throws to reject it */
+  typedef std::function<void(const ConfigTree&)> Validator;
+
+  /** \brief read files and start watching them
+   *
+   * \param files     filenames, in order of precedence
+   * \param overwrite Whether later files overwrite values of earlier ones.
+   * \param validator check of every tree before it is published
+   * \param debounce  quiet time after a change before reloading
+   * \throw std::range_error if the files cannot be read or the tree
+   *        is rejected by validator
+   */
+  explicit ConfigWatcher(const std::vector<std::string>& files, bool overwrite = true,
+                         const Validator& validator = Validator(),
+                         std::chrono::milliseconds debounce = std::chrono::milliseconds(100))
+    : files_(files), overwrite_(overwrite), validator_(validator),
+      debounce_(debounce), stop_(false), reloads_(0), failures_(0), latency_(0),
+      watched_(files)
+  {
+    std::shared_ptr<ConfigTree> tree = read();
+    std::atomic_store(&tree_, std::shared_ptr<const ConfigTree>(tree));
+    watcher_ = std::thread(&ConfigWatcher::watch, this);
+  }
+
+  ConfigWatcher(const ConfigWatcher&) = delete;
+  ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+  ~ConfigWatcher()
+  {
+    stop_ = true;
+    watcher_.join();
+  }
+
+  /** \brief the current tree
+   *
+   * The tree stays valid and unchanged as long as the pointer is held.
+   */
+  std::shared_ptr<const ConfigTree> tree() const
+  {
+    return std::atomic_load(&tree_);
+  }
+
+  /** \brief number of reloads that published a new tree */
+  std::size_t reloads() const
+  {
+    return reloads_;
+  }
+
+  /** \brief number of reloads that failed to parse or validate */
+  std::size_t failures() const
+  {
+    return failures_;
+  }
+
+  /** \brief error of the last failed reload */
+  std::string lastError() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return lastError_;
+  }
+
+  /** \brief time from the first change noticed to the publication of
+   *         the last reloaded tree
+   */
+  std::chrono::microseconds lastLatency() const
+  {
+    return std::chrono::microseconds(latency_.load());
+  }
+
+private:
+
+  typedef std::chrono::steady_clock Clock;
+
+  // parse and validate; on parsing, watched_ becomes the files and the
+  // files they include and fingerprints_ holds their fingerprints
+  std::shared_ptr<ConfigTree> read()
+  {
+    std::vector<std::string> watched = watched_;
+    std::shared_ptr<ConfigTree> tree;
+    std::vector<std::uint64_t> prints;
+    std::vector<std::string> included;
+    for (int attempt = 0; ; ++attempt)
+    {
+      // taken first, so that a change during the parse is seen later
+      prints = fingerprints(watched);
+      tree = std::make_shared<ConfigTree>();
+      ConfigTreeParser::FragmentCache fragments;
+      ConfigTreeParser::readINITrees(files_, *tree, fragments, overwrite_);
+      included = fragments.files();
+      bool unknown = false;
+      for (std::size_t i = 0; i < included.size(); ++i)
+        if (std::find(watched.begin(), watched.end(), included[i]) == watched.end())
+        {
+          watched.push_back(included[i]);
+          unknown = true;
+        }
+      // files included for the first time were parsed unfingerprinted;
+      // a file whose includes keep changing is left to the next reload
+      if (not unknown or attempt == 2)
+        break;
+    }
+
+    std::vector<std::string> current(files_);
+    std::vector<std::uint64_t> currentPrints(prints.begin(), prints.begin() + 2 * files_.size());
+    for (std::size_t i = 0; i < included.size(); ++i)
+    {
+      if (std::find(current.begin(), current.end(), included[i]) not_eq current.end())
+        continue;
+      current.push_back(included[i]);
+      const std::size_t known = std::find(watched.begin(), watched.end(), included[i]) - watched.begin();
+      if (2 * known < prints.size())
+        currentPrints.insert(currentPrints.end(), prints.begin() + 2 * known,
+                             prints.begin() + 2 * known + 2);
+      else
+      {
+        // never matches, so that the file counts as changed
+        currentPrints.push_back(~std::uint64_t(0));
+        currentPrints.push_back(1);
+      }
+    }
+    watched_.swap(current);
+    fingerprints_.swap(currentPrints);
+
+    if (validator_)
+      validator_(*tree);
+    return tree;
+  }
+
+  // parse and publish, measuring from the first change seen
+  void reload(Clock::time_point changed)
+  {
+    try
+    {
+      std::shared_ptr<ConfigTree> tree = read();
+      std::atomic_store(&tree_, std::shared_ptr<const ConfigTree>(tree));
+      latency_ = std::chrono::duration_cast<std::chrono::microseconds>(
+        Clock::now() - changed).count();
+      ++reloads_;
+    }
+    catch (const std::exception& e)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      lastError_ = e.what();
+      ++failures_;
+    }
+  }
+
+  // size and checksum of each file, for watching by polling
+  static std::vector<std::uint64_t> fingerprints(const std::vector<std::string>& files)
+  {
+    std::vector<std::uint64_t> result;
+    for (std::size_t i = 0; i < files.size(); ++i)
+      try
+      {
+        MappedFile file(files[i]);
+        result.push_back(file.size());
+        result.push_back(BinaryConfigTree::checksum(file.data(), file.size()));
+      }
+      catch (const std::exception&)
+      {
+        result.push_back(~std::uint64_t(0));
+        result.push_back(0);
+      }
+    return result;
+  }
+
+  // whether a file changed since the last call
+  bool changed()
+  {
+#if HAVE_INOTIFY
+    if (inotify_ >= 0)
+    {
+      bool changed = false;
+      alignas(struct inotify_event) char buffer[4096];
+      ssize_t n;
+      while ((n = ::read(inotify_, buffer, sizeof(buffer))) > 0)
+        for (char* p = buffer; p < buffer + n; )
+        {
+          const struct inotify_event* event = reinterpret_cast<struct inotify_event*>(p);
+          if (event->len > 0)
+            for (std::size_t i = 0; i < names_.size(); ++i)
+              if (watches_[i] == event->wd and names_[i] == event->name)
+                changed = true;
+          p += sizeof(struct inotify_event) + event->len;
+        }
+      return changed;
+    }
+#endif // HAVE_INOTIFY
+    std::vector<std::uint64_t> current = fingerprints(watched_);
+    if (current == fingerprints_)
+      return false;
+    fingerprints_.swap(current);
+    return true;
+  }
+
+  // wait up to timeout for changes, or for stop_
+  void wait(std::chrono::milliseconds timeout)
+  {
+#if HAVE_INOTIFY
+    if (inotify_ >= 0)
+    {
+      struct pollfd fd = {inotify_, POLLIN, 0};
+      ::poll(&fd, 1, timeout.count());
+      return;
+    }
+#endif // HAVE_INOTIFY
+    std::this_thread::sleep_for(timeout);
+  }
+
+  // watch the directories of watched_, returns whether a file changed
+  // since fingerprints_ were taken
+  bool watchFiles()
+  {
+#if HAVE_INOTIFY
+    // watching a directory again returns its watch
+    names_.clear();
+    watches_.clear();
+    for (std::size_t i = 0; inotify_ >= 0 and i < watched_.size(); ++i)
+    {
+      std::string::size_type slash = watched_[i].rfind('/');
+      std::string directory = (slash == std::string::npos) ? "." : watched_[i].substr(0, slash + 1);
+      names_.push_back(watched_[i].substr(slash == std::string::npos ? 0 : slash + 1));
+      watches_.push_back(::inotify_add_watch(inotify_, directory.c_str(),
+                                             IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO
+                                             | IN_CREATE | IN_DELETE | IN_MOVED_FROM));
+      if (watches_.back() < 0)
+      {
+        ::close(inotify_);
+        inotify_ = -1;
+      }
+    }
+#endif // HAVE_INOTIFY
+    return fingerprints(watched_) not_eq fingerprints_;
+  }
+
+  void watch()
+  {
+#if HAVE_INOTIFY
+    inotify_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif // HAVE_INOTIFY
+
+    // without pending changes wake up regularly to check stop_
+    const std::chrono::milliseconds idle(100);
+    // changes made between reading and watching the files
+    bool pending = watchFiles();
+    Clock::time_point first = Clock::now();
+    Clock::time_point last = first;
+    while (not stop_)
+    {
+      wait(pending ? debounce_ : std::min(idle, debounce_));
+      const Clock::time_point now = Clock::now();
+      if (changed())
+      {
+        if (not pending)
+          first = now;
+        pending = true;
+        last = now;
+      }
+      else if (pending and now - last >= debounce_)
+      {
+        reload(first);
+        // changes made during the reload, also to newly included files
+        pending = watchFiles();
+        first = last = Clock::now();
+      }
+    }
+
+#if HAVE_INOTIFY
+    if (inotify_ >= 0)
+      ::close(inotify_);
+#endif // HAVE_INOTIFY
+  }
+
+  const std::vector<std::string> files_;
+  const bool overwrite_;
+  const Validator validator_;
+  const std::chrono::milliseconds debounce_;
+
+  std::shared_ptr<const ConfigTree> tree_;
+  std::thread watcher_;
+  std::atomic<bool> stop_;
+
+  std::atomic<std::size_t> reloads_;
+  std::atomic<std::size_t> failures_;
+  std::atomic<long long> latency_;
+  mutable std::mutex mutex_;
+  std::string lastError_;
+
+  // used by the watching thread only, once constructed
+  std::vector<std::string> watched_;
+  std::vector<std::uint64_t> fingerprints_;
+#if HAVE_INOTIFY
+  int inotify_ = -1;
+  std::vector<int> watches_;
+  std::vector<std::string> names_;
+#endif // HAVE_INOTIFY
+};
+
+#endif // CONFIGWATCHER_HH
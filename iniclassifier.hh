@@ -0,0 +1,290 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef INICLASSIFIER_HH
+#define INICLASSIFIER_HH
+
+/** \file
+ * \brief Block-wise classification of the delimiters of the INITree format
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#ifndef CONFIGTREE_NO_SIMD
+#if defined(__AVX2__) or defined(__SSE2__)
+#include <immintrin.h>
+#endif
+// with GCC and clang on x86-64 the AVX2 version is selected at run time
+#if not defined(__AVX2__) and defined(__x86_64__) and defined(__GNUC__)
+#define CONFIGTREE_AVX2_DISPATCH 1
+#endif
+#endif // CONFIGTREE_NO_SIMD
+
+/** \brief Locate the delimiters of the INITree format in blocks of input
+ *
+ * classify() finds all newlines, '#', '=', quotes and brackets in a
+ * block of 64 characters in one pass and returns their positions as
+ * bit masks. It uses AVX2 or SSE2 where the compiler targets them and
+ * a table driven loop otherwise; define CONFIGTREE_NO_SIMD to force the
+ * portable version.
+ */
+class INIClassifier
+{
+public:
+
+  //! number of characters classified at once
+  static const std::size_t blockSize = 64;
+
+  //! delimiter kinds, to select from a Masks object
+  enum Kind
+  {
+    newline = 1,
+    comment = 2,
+    assign  = 4,
+    quote   = 8,
+    bracket = 16
+  };
+
+  /** \brief positions of the delimiters in a block, bit i for character i */
+  struct Masks
+  {
+    std::uint64_t newline;  //!< '\\n'
+    std::uint64_t comment;  //!< '#'
+    std::uint64_t assign;   //!< '='
+    std::uint64_t quote;    //!< '"' and '\\''
+    std::uint64_t bracket;  //!< '[' and ']'
+
+    //! union of the masks of the given kinds
+    std::uint64_t select(unsigned kinds) const
+    {
+      return ((kinds & INIClassifier::newline) ? newline : 0)
+        | ((kinds & INIClassifier::comment) ? comment : 0)
+        | ((kinds & INIClassifier::assign) ? assign : 0)
+        | ((kinds & INIClassifier::quote) ? quote : 0)
+        | ((kinds & INIClassifier::bracket) ? bracket : 0);
+    }
+  };
+
+  /** \brief classify the blockSize characters starting at block
+   *
+   * Only the masks of the selected kinds are computed, the others are
+   * set to zero.
+   */
+  static void classify(const char* block, Masks& masks, unsigned kinds = ~0u)
+  {
+#if defined(CONFIGTREE_NO_SIMD)
+    classifyScalar(block, masks);
+    masks = keep(masks, kinds);
+#elif defined(__AVX2__)
+    classifyAVX2(block, masks, kinds);
+#elif CONFIGTREE_AVX2_DISPATCH
+    // not compiled for AVX2, but the CPU may have it
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2)
+      classifyAVX2(block, masks, kinds);
+    else
+      classifySSE2(block, masks, kinds);
+#elif defined(__SSE2__)
+    classifySSE2(block, masks, kinds);
+#else
+    classifyScalar(block, masks);
+    masks = keep(masks, kinds);
+#endif
+  }
+
+  /** \brief portable version of classify() */
+  static void classifyScalar(const char* block, Masks& masks)
+  {
+    static const Table table;
+    std::uint64_t m[6] = { 0, 0, 0, 0, 0, 0 };
+    for (std::size_t i = 0; i < blockSize; ++i)
+      m[table.kind[static_cast<unsigned char>(block[i])]] |= std::uint64_t(1) << i;
+    masks.newline = m[1];
+    masks.comment = m[2];
+    masks.assign  = m[3];
+    masks.quote   = m[4];
+    masks.bracket = m[5];
+  }
+
+  /** \brief copy of masks with the kinds not selected cleared */
+  static Masks keep(Masks masks, unsigned kinds)
+  {
+    if (not (kinds & newline)) masks.newline = 0;
+    if (not (kinds & comment)) masks.comment = 0;
+    if (not (kinds & assign)) masks.assign = 0;
+    if (not (kinds & quote)) masks.quote = 0;
+    if (not (kinds & bracket)) masks.bracket = 0;
+    return masks;
+  }
+
+  /** \brief index of the lowest set bit of a non-zero mask */
+  static unsigned lowestBit(std::uint64_t mask)
+  {
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    unsigned i = 0;
+    while (not (mask & 1))
+    {
+      mask >>= 1;
+      ++i;
+    }
+    return i;
+#endif
+  }
+
+  /** \brief Forward search for delimiters
+   *
+   * Classifies the input one block at a time, when the search first
+   * reaches it, and keeps the masks of the selected kinds for the
+   * current block. Callers can either ask for the next selected
+   * delimiter with find() or do their own bit arithmetic on the masks
+   * of block().
+   * Queries are cheapest when their positions increase monotonically.
+   */
+  class Cursor
+  {
+  public:
+
+    Cursor(const char* begin, const char* end, unsigned kinds = ~0u)
+      : begin_(begin), end_(end), kinds_(kinds), block_(nullptr)
+    {}
+
+    /** \brief classify the block containing pos < end
+     *
+     * \return the start of the block, masks() holds its delimiters
+     */
+    const char* block(const char* pos)
+    {
+      if (block_ == nullptr or pos < block_ or pos >= block_ + blockSize)
+        load(begin_ + (pos - begin_) / blockSize * blockSize);
+      return block_;
+    }
+
+    /** \brief delimiters in the current block, none beyond the end of input */
+    const Masks& masks() const
+    {
+      return masks_;
+    }
+
+    /** \brief first selected delimiter in [pos, end), or end if there is none */
+    const char* find(const char* pos)
+    {
+      if (pos >= end_)
+        return end_;
+      block(pos);
+      std::uint64_t bits = masks_.select(~0u) & (~std::uint64_t(0) << (pos - block_));
+      while (bits == 0)
+      {
+        if (block_ + blockSize >= end_)
+          return end_;
+        load(block_ + blockSize);
+        bits = masks_.select(~0u);
+      }
+      return block_ + lowestBit(bits);
+    }
+
+  private:
+
+    void load(const char* block)
+    {
+      block_ = block;
+      if (end_ - block >= std::ptrdiff_t(blockSize))
+        INIClassifier::classify(block, masks_, kinds_);
+      else
+      {
+        // pad the tail and mask the padding off
+        char tail[blockSize] = { 0 };
+        std::memcpy(tail, block, end_ - block);
+        INIClassifier::classify(tail, masks_, kinds_);
+        const std::uint64_t valid = (std::uint64_t(1) << (end_ - block)) - 1;
+        masks_.newline &= valid;
+        masks_.comment &= valid;
+        masks_.assign &= valid;
+        masks_.quote &= valid;
+        masks_.bracket &= valid;
+      }
+    }
+
+    const char* begin_;
+    const char* end_;
+    unsigned kinds_;
+    const char* block_;
+    Masks masks_;
+  };
+
+private:
+
+  struct Table
+  {
+    unsigned char kind[256];
+    Table()
+    {
+      std::memset(kind, 0, sizeof(kind));
+      kind[static_cast<unsigned char>('\n')] = 1;
+      kind[static_cast<unsigned char>('#')] = 2;
+      kind[static_cast<unsigned char>('=')] = 3;
+      kind[static_cast<unsigned char>('"')] = 4;
+      kind[static_cast<unsigned char>('\'')] = 4;
+      kind[static_cast<unsigned char>('[')] = 5;
+      kind[static_cast<unsigned char>(']')] = 5;
+    }
+  };
+
+#ifndef CONFIGTREE_NO_SIMD
+#if defined(__AVX2__) or CONFIGTREE_AVX2_DISPATCH
+#if not defined(__AVX2__)
+  __attribute__((target("avx2")))
+#endif
+  static void classifyAVX2(const char* block, Masks& masks, unsigned kinds)
+  {
+    const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    const __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32));
+    struct Match
+    {
+      __m256i lo, hi;
+#if not defined(__AVX2__)
+      __attribute__((target("avx2")))
+#endif
+      std::uint64_t operator()(char c) const
+      {
+        const __m256i pattern = _mm256_set1_epi8(c);
+        std::uint32_t l = _mm256_movemask_epi8(_mm256_cmpeq_epi8(lo, pattern));
+        std::uint32_t h = _mm256_movemask_epi8(_mm256_cmpeq_epi8(hi, pattern));
+        return std::uint64_t(l) | (std::uint64_t(h) << 32);
+      }
+    } match = { lo, hi };
+    masks.newline = (kinds & newline) ? match('\n') : 0;
+    masks.comment = (kinds & comment) ? match('#') : 0;
+    masks.assign  = (kinds & assign) ? match('=') : 0;
+    masks.quote   = (kinds & quote) ? match('"') | match('\'') : 0;
+    masks.bracket = (kinds & bracket) ? match('[') | match(']') : 0;
+  }
+#endif
+#if defined(__SSE2__)
+  static std::uint64_t match(const __m128i* chunk, char c)
+  {
+    const __m128i pattern = _mm_set1_epi8(c);
+    std::uint64_t mask = 0;
+    for (int i = 0; i < 4; ++i)
+      mask |= std::uint64_t(std::uint16_t(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(chunk[i], pattern)))) << (16*i);
+    return mask;
+  }
+
+  static void classifySSE2(const char* block, Masks& masks, unsigned kinds)
+  {
+    __m128i chunk[4];
+    for (int i = 0; i < 4; ++i)
+      chunk[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16*i));
+    masks.newline = (kinds & newline) ? match(chunk, '\n') : 0;
+    masks.comment = (kinds & comment) ? match(chunk, '#') : 0;
+    masks.assign  = (kinds & assign) ? match(chunk, '=') : 0;
+    masks.quote   = (kinds & quote) ? match(chunk, '"') | match(chunk, '\'') : 0;
+    masks.bracket = (kinds & bracket) ? match(chunk, '[') | match(chunk, ']') : 0;
+  }
+#endif
+#endif // CONFIGTREE_NO_SIMD
+};
+
+#endif
@@ -0,0 +1,389 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef INISCANNER_HH
+#define INISCANNER_HH
+
+/** \file
+ * \brief Tokenizer for the INITree file format
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "iniclassifier.hh"
+#include "stringview.hh"
+
+/** \brief Single-pass tokenizer for the INITree file format
+ *
+ * Splits a contiguous buffer into section headers and key/value
+ * entries, following the grammar documented at
+ * ConfigTreeParser::readINITree. Tokens are views into the buffer, so
+ * scanning does not allocate. The only exception is a quoted multiline
+ * value whose first line carries a comment: it is not contiguous in the
+ * input and gets assembled in a scratch buffer owned by the scanner.
+ * Either way a token stays valid until the next call of next().
+ *
+ * Newlines, '#' and '=' are located with INIClassifier, so each byte
+ * of the input is classified once, a block at a time.
+ */
+class INIScanner
+{
+public:
+
+  /** \brief a section header, a key/value entry or an include line
+   *
+   * An include line is a line without assignment starting with the word
+   * \c include followed by a file name. Lines the grammar ignores, a
+   * section header without closing bracket or a line without assignment,
+   * are returned as ignored tokens if enabled with reportIgnored().
+   */
+  struct Token
+  {
+    enum Kind { section, entry, include, ignored };
+
+    Kind kind;
+    //! section name or key, without surrounding whitespace; the whole
+    //! line for ignored tokens
+    StringView key;
+    //! value of an entry or file name of an include, trimmed and unquoted
+    StringView value;
+    //! line the token starts on, counting from 1
+    std::size_t line;
+    //! columns of key and value on that line, counting from 1
+    std::size_t column;
+    std::size_t valueColumn;
+    //! whether a quoted value lacks its closing quote and extends to the
+    //! end of the input
+    bool unterminated;
+  };
+
+  /** \brief scan the characters in [begin, end) */
+  INIScanner(const char* begin, const char* end)
+    : INIScanner(begin, end, end)
+  {}
+
+  /** \brief scan the lines of [begin, end) which start before stop
+   *
+   * begin and stop have to be line starts. The continuation lines of a
+   * quoted value may extend beyond stop, position() tells where the
+   * scanner finished.
+   *
+   * \param firstLine number of the line starting at begin
+   * \param final     whether end is the end of the input. If not, a last
+   *                  line without newline or a quoted value still open
+   *                  at end are incomplete: the scanner stops in front
+   *                  of them and openQuote() tells which case it is.
+   */
+  INIScanner(const char* begin, const char* end, const char* stop,
+             std::size_t firstLine = 1, bool final = true)
+    : pos_(begin), end_(end), stop_(stop), final_(final), eof_(false),
+      line_(firstLine-1), openQuote_(0), reportIgnored_(false),
+      delimiters_(begin, end, INIClassifier::newline
+                  | INIClassifier::comment | INIClassifier::assign),
+      quotes_(begin, end, INIClassifier::quote),
+      comment_(nullptr), assign_(nullptr)
+  {}
+
+  /** \brief fetch the next token
+   *
+   * \return false once the input is exhausted
+   */
+  bool next(Token& token)
+  {
+    const char* b;
+    const char* e;
+    while (pos_ < stop_ or stop_ == end_)
+    {
+      const char* start = pos_;
+      const std::size_t startLine = line_;
+      if (not nextLine(b, e))
+        return false;
+      if (eof_ and not final_)
+        return incomplete(start, startLine, 0);
+
+      const char* lineBegin = b;
+      while (b not_eq e and isSpace(*b))
+        ++b;
+      if (b == e or *b == '#')
+        continue;
+
+      token.line = line_;
+      token.unterminated = false;
+      if (*b == '[')
+      {
+        while (isSpace(e[-1]))
+          --e;
+        // a header without closing bracket is ignored
+        if (e[-1] not_eq ']' or e - b < 2)
+        {
+          if (reportIgnored_)
+            return ignored(token, lineBegin, b, e);
+          continue;
+        }
+        token.kind = Token::section;
+        token.key = trim(b+1, e-1);
+        token.value = StringView();
+        token.column = token.key.data() - lineBegin + 1;
+        token.valueColumn = 0;
+        return true;
+      }
+
+      const char* comment = comment_;
+      if (comment)
+        e = comment;
+      const char* mid = (assign_ and assign_ < e) ? assign_ : nullptr;
+      // lines without assignment are ignored, except for includes
+      if (not mid)
+      {
+        if (e - b > 8 and std::memcmp(b, "include", 7) == 0 and isSpace(b[7]))
+        {
+          token.kind = Token::include;
+          token.key = StringView(b, 7);
+          token.value = trim(b+7, e);
+          token.column = b - lineBegin + 1;
+          token.valueColumn = token.value.data() - lineBegin + 1;
+          return true;
+        }
+        if (reportIgnored_)
+          return ignored(token, lineBegin, b, e);
+        continue;
+      }
+
+      token.kind = Token::entry;
+      token.key = trim(b, mid);
+      token.column = token.key.data() - lineBegin + 1;
+
+      const char* vb = mid+1;
+      while (vb not_eq e and isSpace(*vb))
+        ++vb;
+      const char* le = e;
+      while (vb not_eq e and isSpace(e[-1]))
+        --e;
+
+      token.valueColumn = vb - lineBegin + 1;
+      if (vb == e or (*vb not_eq '\'' and *vb not_eq '"'))
+      {
+        token.value = StringView(vb, e);
+        return true;
+      }
+
+      // quoted value, possibly spanning several lines
+      const char quote = *vb++;
+      if (vb not_eq e and e[-1] == quote)
+      {
+        token.value = StringView(vb, e-1);
+        return true;
+      }
+      if (not comment)
+      {
+        const char* close = closingQuote(quote);
+        if (eof_ and not final_)
+          return incomplete(start, startLine, quote);
+        token.value = StringView(vb, close ? close : end_);
+        token.unterminated = not close;
+        return true;
+      }
+      // the value is not contiguous in the input, as the first line lost
+      // its comment. Only the last line read can close the value, so its
+      // last non-whitespace character is all we have to look at.
+      scratch_.assign(vb, le);
+      bool closed = false;
+      while (not closed)
+      {
+        if (nextLine(b, e))
+        {
+          if (eof_ and not final_)
+            return incomplete(start, startLine, quote);
+          scratch_ += '\n';
+          scratch_.append(b, e);
+          while (e not_eq b and isSpace(e[-1]))
+            --e;
+          closed = (e not_eq b and e[-1] == quote);
+        }
+        else
+        {
+          // an unterminated value extends to the end of the input
+          scratch_ += quote;
+          closed = true;
+          token.unterminated = true;
+        }
+      }
+      std::size_t last = scratch_.find_last_not_of(" \t\n\r");
+      token.value = StringView(scratch_.data(), last);
+      return true;
+    }
+    return false;
+  }
+
+  /** \brief return the lines the grammar ignores as tokens, too */
+  void reportIgnored(bool enable = true)
+  {
+    reportIgnored_ = enable;
+  }
+
+  /** \brief quote character of an incomplete quoted value
+   *
+   * After next() returned false on input that is not final: the quote
+   * of the value the scanner stopped in front of, or 0 if it stopped in
+   * front of an incomplete line.
+   */
+  char openQuote() const
+  {
+    return openQuote_;
+  }
+
+  /** \brief end of the first line in [b, e) whose last non-whitespace
+   *         character is quote, or nullptr if there is no such line
+   *
+   * Returns the position of the newline ending that line; lines without
+   * newline do not count.
+   */
+  static const char* closingLine(const char* b, const char* e, char quote)
+  {
+    for (const char* q = b; (q = static_cast<const char*>(std::memchr(q, quote, e - q))); )
+    {
+      const char* t = ++q;
+      while (t not_eq e and (*t == ' ' or *t == '\t' or *t == '\r'))
+        ++t;
+      if (t not_eq e and *t == '\n')
+        return t;
+    }
+    return nullptr;
+  }
+
+  /** \brief start of the first line not read yet */
+  const char* position() const
+  {
+    return pos_;
+  }
+
+  /** \brief number of the last line read */
+  std::size_t line() const
+  {
+    return line_;
+  }
+
+  static bool isSpace(char c)
+  {
+    return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+  }
+
+  /** \brief view of [b, e) without leading and trailing whitespace */
+  static StringView trim(const char* b, const char* e)
+  {
+    while (b not_eq e and isSpace(*b))
+      ++b;
+    while (b not_eq e and isSpace(e[-1]))
+      --e;
+    return StringView(b, e);
+  }
+
+private:
+
+  // an ignored line [b, e), starting with its first non-whitespace
+  bool ignored(Token& token, const char* lineBegin, const char* b, const char* e)
+  {
+    token.kind = Token::ignored;
+    token.key = trim(b, e);
+    token.value = StringView();
+    token.column = b - lineBegin + 1;
+    token.valueColumn = 0;
+    return true;
+  }
+
+  // step back in front of an incomplete token
+  bool incomplete(const char* start, std::size_t startLine, char quote)
+  {
+    pos_ = start;
+    line_ = startLine;
+    eof_ = false;
+    openQuote_ = quote;
+    return false;
+  }
+
+  // consume the continuation lines of a quoted value, up to the line
+  // whose last non-whitespace character is the closing quote. Only
+  // quote characters are visited, so the cost does not depend on the
+  // number of lines. Returns the closing quote, or nullptr if the
+  // value is unterminated and extends to the end of the input.
+  const char* closingQuote(char quote)
+  {
+    const char* start = pos_;
+    if (eof_)
+      return nullptr;
+    for (const char* q = quotes_.find(pos_); q not_eq end_; q = quotes_.find(q+1))
+    {
+      if (*q not_eq quote)
+        continue;
+      const char* t = q+1;
+      while (t not_eq end_ and (*t == ' ' or *t == '\t' or *t == '\r'))
+        ++t;
+      if (t == end_ or *t == '\n')
+      {
+        line_ += std::count(start, t, '\n') + 1;
+        eof_ = (t == end_);
+        pos_ = eof_ ? end_ : t+1;
+        return q;
+      }
+    }
+    line_ += std::count(start, end_, '\n') + 1;
+    pos_ = end_;
+    eof_ = true;
+    return nullptr;
+  }
+
+  // fetch the next line, with the semantics of std::getline on a stream
+  // holding the buffer: n newlines separate n+1 lines. Records the
+  // first '#' and '=' of the line on the way.
+  bool nextLine(const char*& b, const char*& e)
+  {
+    if (eof_)
+      return false;
+    ++line_;
+    b = pos_;
+    comment_ = nullptr;
+    assign_ = nullptr;
+    for (const char* p = pos_; p < end_; )
+    {
+      const char* block = delimiters_.block(p);
+      const INIClassifier::Masks& masks = delimiters_.masks();
+      const std::uint64_t from = ~std::uint64_t(0) << (p - block);
+      const std::uint64_t nl = masks.newline & from;
+      // bits from p up to the end of the line or block
+      const std::uint64_t line = from & (nl ? (nl & (~nl + 1)) - 1 : ~std::uint64_t(0));
+      if (not comment_ and (masks.comment & line))
+        comment_ = block + INIClassifier::lowestBit(masks.comment & line);
+      if (not assign_ and (masks.assign & line))
+        assign_ = block + INIClassifier::lowestBit(masks.assign & line);
+      if (nl)
+      {
+        e = block + INIClassifier::lowestBit(nl);
+        pos_ = e + 1;
+        return true;
+      }
+      p = block + INIClassifier::blockSize;
+    }
+    e = end_;
+    pos_ = end_;
+    eof_ = true;
+    return true;
+  }
+
+  const char* pos_;
+  const char* end_;
+  const char* stop_;
+  bool final_;
+  bool eof_;
+  std::size_t line_;
+  char openQuote_;
+  bool reportIgnored_;
+  INIClassifier::Cursor delimiters_;
+  INIClassifier::Cursor quotes_;
+  // first '#' and '=' on the current line, if any
+  const char* comment_;
+  const char* assign_;
+  std::string scratch_;
+};
+
+#endif
@@ -0,0 +1,247 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef INIWRITER_HH
+#define INIWRITER_HH
+
+/** \file
+ * \brief Writer of ConfigTree objects in the INITree file format
+ */
+
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "configtree.hh"
+#include "configtreewriter.hh"
+
+/** \brief Writer of ConfigTree objects in the INITree file format
+ *
+ * The output reads back with ConfigTreeParser::readINITree() into the
+ * same tree: the values of the root come first, then a section for
+ * every substructure holding values. Values are quoted only where the
+ * grammar requires it, i.e. if they span several lines, start with a
+ * quote or start or end with whitespace. Keys that cannot appear in a
+ * section of their own, like ones starting with whitespace, are written
+ * as dotted keys in the section of an ancestor.
+ *
+ * Some trees have no INI representation, as the grammar has no escapes:
+ * keys containing '=', '#' or line breaks, keys named "include", and
+ * values with a '#' on their first line. Writing such a tree throws
+ * std::range_error. Trees read from INI input can always be written.
+ * Substructures without values and without substructures holding values
+ * are not written.
+ *
+ * Output is collected in a buffer of bufferSize bytes and handed to the
+ * stream in one piece whenever it is full.
+ */
+class INIWriter : public ConfigTreeWriter
+{
+public:
+
+  /** \brief write pt in the INI format to a stream
+   *
+   * \throw std::range_error if pt has no INI representation
+   */
+  static void write(const ConfigTree& pt, std::ostream& out, Order order = insertion)
+  {
+    std::string buffer;
+    buffer.reserve(bufferSize + bufferSize / 4);
+    INIWriter writer(buffer, &out, order);
+    writer.tree(pt);
+    writer.flush();
+  }
+
+  /** \brief write pt in the INI format to the file with the given name
+   *
+   * \throw std::range_error if pt has no INI representation
+   * \throw std::ofstream::failure if the file cannot be written
+   */
+  static void write(const ConfigTree& pt, const std::string& file, Order order = insertion)
+  {
+    writeFile<INIWriter>(pt, file, order);
+  }
+
+  /** \brief pt in the INI format
+   *
+   * \throw std::range_error if pt has no INI representation
+   */
+  static std::string str(const ConfigTree& pt, Order order = insertion)
+  {
+    std::string buffer;
+    INIWriter writer(buffer, nullptr, order);
+    writer.tree(pt);
+    return buffer;
+  }
+
+private:
+
+  // without out, buffer grows and takes the whole output
+  INIWriter(std::string& buffer, std::ostream* out, Order order)
+    : ConfigTreeWriter(buffer, out, order), sectionOk_(true)
+  {}
+
+  // write pt, the substructure named by section_
+  void tree(const ConfigTree& pt)
+  {
+    sectionOk_ = starts_.empty() or validSection(section_);
+    if (order_ == sorted)
+      for (ConfigTree::ValueMap::const_iterator it = pt.values_.begin();
+           it not_eq pt.values_.end(); ++it)
+        entry(it->first, it->second.value);
+    else
+      for (std::size_t i = 0; i < pt.valueKeys_.size(); ++i)
+        entry(pt.valueKeys_[i], pt.values_.find(pt.valueKeys_[i])->second.value);
+    if (order_ == sorted)
+      for (std::map<std::string, ConfigTree>::const_iterator it = pt.subs_.begin();
+           it not_eq pt.subs_.end(); ++it)
+        subtree(it->first, it->second);
+    else
+      for (std::size_t i = 0; i < pt.subKeys_.size(); ++i)
+        subtree(pt.subKeys_[i], pt.subs_.find(pt.subKeys_[i])->second);
+  }
+
+  void subtree(const std::string& name, const ConfigTree& sub)
+  {
+    const std::size_t length = section_.size();
+    if (not starts_.empty())
+      section_ += '.';
+    starts_.push_back(section_.size());
+    section_ += name;
+    tree(sub);
+    section_.resize(length);
+    starts_.pop_back();
+    sectionOk_ = starts_.empty() or validSection(section_);
+  }
+
+  // write a value of the current substructure, in its own section if
+  // possible, else as a dotted key in the section of an ancestor
+  void entry(const std::string& key, const std::string& value)
+  {
+    if (sectionOk_ and validKey(key))
+    {
+      header(section_);
+      buffer_ += key;
+    }
+    else
+    {
+      std::size_t depth = starts_.size();
+      std::string dotted;
+      do
+      {
+        if (depth == 0)
+          fail("Key '" + name(key) + "'");
+        --depth;
+        dotted = section_.substr(starts_[depth]) + "." + key;
+      } while (not validKey(dotted)
+               or (depth > 0 and not validSection(section_.substr(0, starts_[depth] - 1))));
+      header(depth > 0 ? section_.substr(0, starts_[depth] - 1) : std::string());
+      buffer_ += dotted;
+    }
+
+    const char* data = value.data();
+    const std::size_t size = value.size();
+    const char* newline = static_cast<const char*>(std::memchr(data, '\n', size));
+    // a comment ends the first line of any value
+    if (std::memchr(data, '#', newline ? newline - data : size))
+      fail("Value of key '" + name(key) + "'");
+    buffer_ += " = ";
+    if (size > 0 and (newline or isSpace(data[0]) or isSpace(data[size-1])
+                      or data[0] == '"' or data[0] == '\''))
+    {
+      const char quote = newline ? multilineQuote(key, value) : '"';
+      buffer_ += quote;
+      buffer_ += value;
+      buffer_ += quote;
+    }
+    else
+      buffer_ += value;
+    buffer_ += '\n';
+    if (out_ and buffer_.size() >= bufferSize)
+      flush();
+  }
+
+  // start the section with the given name, unless it is the current one.
+  // The empty name stands for the tree written.
+  void header(const std::string& section)
+  {
+    if (section == header_)
+      return;
+    buffer_ += '[';
+    buffer_ += section;
+    buffer_ += "]\n";
+    header_ = section;
+  }
+
+  // whether a section header reads back as the given name
+  static bool validSection(const std::string& section)
+  {
+    return not section.empty() and not isSpace(section[0])
+      and not isSpace(section[section.size()-1])
+      and section.find('\n') == std::string::npos;
+  }
+
+  // whether an entry reads back with the given key
+  static bool validKey(const std::string& key)
+  {
+    const std::size_t size = key.size();
+    if (size == 0)
+      return true;
+    if (key[0] == '[' or isSpace(key[0]) or isSpace(key[size-1])
+        or (size == 7 and key == "include"))
+      return false;
+    for (std::size_t i = 0; i < size; ++i)
+      if (key[i] == '=' or key[i] == '#' or key[i] == '\n')
+        return false;
+    return true;
+  }
+
+  // a quote that does not end any line of value early: a quote is
+  // closing if only whitespace follows it on its line
+  char multilineQuote(const std::string& key, const std::string& value) const
+  {
+    const char quotes[] = {'"', '\''};
+    for (std::size_t q = 0; q < 2; ++q)
+    {
+      bool closes = false;
+      for (std::size_t p = value.find(quotes[q]); not closes and p not_eq std::string::npos;
+           p = value.find(quotes[q], p + 1))
+      {
+        std::size_t t = value.find_first_not_of(" \t\r", p + 1);
+        closes = (t not_eq std::string::npos and value[t] == '\n');
+      }
+      if (not closes)
+        return quotes[q];
+    }
+    fail("Value of key '" + name(key) + "'");
+    return 0;
+  }
+
+  // full name of a key of the current section
+  std::string name(const std::string& key) const
+  {
+    return section_.empty() ? key : section_ + "." + key;
+  }
+
+  static bool isSpace(char c)
+  {
+    return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+  }
+
+  static void fail(const std::string& what)
+  {
+    throw std::range_error(what + " cannot be written in the INI format");
+  }
+
+  // name of the current substructure, and the start of each of its
+  // components
+  std::string section_;
+  std::vector<std::size_t> starts_;
+  // whether the current substructure can have a section of its own
+  bool sectionOk_;
+  // name of the current section
+  std::string header_;
+};
+
+#endif // INIWRITER_HH
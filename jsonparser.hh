@@ -0,0 +1,520 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef JSONPARSER_HH
+#define JSONPARSER_HH
+
+/** \file
+ * \brief Parser of JSON documents into ConfigTree objects
+ */
+
+#include <cstring>
+#include <istream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include "configtree.hh"
+#include "mappedfile.hh"
+
+/** \brief Parser of JSON documents into ConfigTree objects
+ *
+ * The document must be an object. Its members become values of the tree,
+ * nested objects become substructures. Like keys of the INI format, keys
+ * containing dots name values of substructures. Values keep their text:
+ * strings are unescaped, numbers are stored as written, true and false
+ * as "true" and "false", and null as an empty value. Arrays are read
+ * according to the ArrayMode.
+ *
+ * The input is parsed in a single pass, storing every value as soon as
+ * it is read. Keys appearing twice are errors, as in ConfigTreeParser.
+ * Errors throw std::range_error naming the source and line.
+ */
+class JSONParser
+{
+public:
+
+  /** \brief how arrays are stored in the tree */
+  enum ArrayMode
+  {
+    joined,  //!< one value of the elements separated by spaces, as read
+             //!< by get<std::vector<T> >(); elements must be scalars,
+             //!< and strings must be neither empty nor hold whitespace
+    indexed  //!< a substructure with the elements named "0", "1", ...
+  };
+
+  /** \brief maximal nesting of objects and arrays */
+  static const std::size_t maxDepth = 512;
+
+  /** \brief parse character buffer
+   *
+   * \param data    Start of the buffer to parse
+   * \param size    Number of characters in the buffer
+   * \param[out] pt The parameter tree to store the config structure.
+   * \param arrays  How arrays are stored.
+   * \param srcname Name of the configuration source for error messages.
+   * \param overwrite Whether to overwrite already existing values.
+   *                  If false, values in the buffer will be ignored
+   *                  if the key is already present.
+   */
+  static void readJSONTree(const char* data, std::size_t size, ConfigTree& pt,
+                           ArrayMode arrays = joined,
+                           const std::string& srcname = "buffer",
+                           bool overwrite = true)
+  {
+    JSONParser parser(data, data + size, pt, arrays, srcname, overwrite);
+    parser.document(pt);
+  }
+
+  /** \brief parse C++ stream
+   *
+   * \param in      The stream to parse
+   * \param[out] pt The parameter tree to store the config structure.
+   * \param arrays  How arrays are stored.
+   * \param srcname Name of the configuration source for error messages.
+   * \param overwrite Whether to overwrite already existing values.
+   */
+  static void readJSONTree(std::istream& in, ConfigTree& pt,
+                           ArrayMode arrays = joined,
+                           const std::string& srcname = "stream",
+                           bool overwrite = true)
+  {
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    const std::string text = contents.str();
+    readJSONTree(text.data(), text.size(), pt, arrays, srcname, overwrite);
+  }
+
+  /** \brief parse file
+   *
+   * The file is memory mapped (where supported) and parsed in place.
+   *
+   * \param file    filename
+   * \param[out] pt The parameter tree to store the config structure.
+   * \param arrays  How arrays are stored.
+   * \param overwrite Whether to overwrite already existing values.
+   * \throw std::ifstream::failure if the file cannot be opened
+   */
+  static void readJSONTree(const std::string& file, ConfigTree& pt,
+                           ArrayMode arrays = joined, bool overwrite = true)
+  {
+    MappedFile in(file);
+    readJSONTree(in.data(), in.size(), pt, arrays, "file '" + file + "'", overwrite);
+  }
+
+private:
+
+  JSONParser(const char* begin, const char* end, ConfigTree& pt, ArrayMode arrays,
+             const std::string& srcname, bool overwrite)
+    : p_(begin), end_(end), line_(1), depth_(0), arrays_(arrays),
+      srcname_(srcname), overwrite_(overwrite),
+      // values read by this parse are marked with its source id,
+      // meeting such a mark again reveals a duplicate
+      source_(ConfigTree::newSource()), track_(pt.locationTracking())
+  {
+    if (track_)
+      pt.addSource(source_, srcname_);
+    // values are changed in place
+    pt.forgetResolved();
+  }
+
+  void document(ConfigTree& pt)
+  {
+    // a byte order mark
+    if (end_ - p_ >= 3 and p_[0] == '\xef' and p_[1] == '\xbb' and p_[2] == '\xbf')
+      p_ += 3;
+    skipSpace();
+    if (p_ == end_ or *p_ not_eq '{')
+      fail("Expected an object");
+    object(pt);
+    skipSpace();
+    if (p_ not_eq end_)
+      fail("Unexpected characters after the object");
+  }
+
+  // read the object at p_ into t
+  void object(ConfigTree& t)
+  {
+    enter();
+    ++p_;
+    skipSpace();
+    std::string key;
+    if (p_ not_eq end_ and *p_ == '}')
+      ++p_;
+    else
+      for (;;)
+      {
+        if (p_ == end_ or *p_ not_eq '"')
+          fail("Expected a key");
+        quoted(key);
+        skipSpace();
+        if (p_ == end_ or *p_ not_eq ':')
+          fail("Expected ':' after key '" + t.prefix_ + key + "'");
+        ++p_;
+        member(t, key);
+        skipSpace();
+        if (p_ not_eq end_ and *p_ == ',')
+        {
+          ++p_;
+          skipSpace();
+        }
+        else if (p_ not_eq end_ and *p_ == '}')
+        {
+          ++p_;
+          break;
+        }
+        else
+          fail("Expected ',' or '}'");
+      }
+    --depth_;
+  }
+
+  // read the value of member key of t
+  void member(ConfigTree& t, const std::string& key)
+  {
+    skipSpace();
+    std::string::size_type dot = key.find('.');
+    if (dot not_eq std::string::npos)
+    {
+      // a component that is a value fails here, naming source and line
+      ConfigTree* s = &t;
+      std::string::size_type start = 0;
+      for (; dot not_eq std::string::npos; start = dot + 1, dot = key.find('.', start))
+        s = &subtree(*s, key.substr(start, dot - start));
+      member(*s, key.substr(start));
+      return;
+    }
+    if (p_ == end_)
+      fail("Expected a value");
+    if (*p_ == '{')
+      object(subtree(t, key));
+    else if (*p_ == '[' and arrays_ == indexed)
+      array(subtree(t, key));
+    else
+    {
+      const std::size_t line = line_;
+      if (*p_ == '[')
+        joinedArray(t, key);
+      else
+        scalar(value_);
+      store(t, key, line);
+    }
+  }
+
+  // read the array at p_ into t, the elements named by their index
+  void array(ConfigTree& t)
+  {
+    enter();
+    ++p_;
+    skipSpace();
+    if (p_ not_eq end_ and *p_ == ']')
+      ++p_;
+    else
+      for (std::size_t i = 0; ; ++i)
+      {
+        member(t, std::to_string(i));
+        skipSpace();
+        if (p_ not_eq end_ and *p_ == ',')
+          ++p_;
+        else if (p_ not_eq end_ and *p_ == ']')
+        {
+          ++p_;
+          break;
+        }
+        else
+          fail("Expected ',' or ']'");
+      }
+    --depth_;
+  }
+
+  // read the array at p_ into value_, the elements separated by spaces
+  void joinedArray(const ConfigTree& t, const std::string& key)
+  {
+    ++p_;
+    skipSpace();
+    value_.clear();
+    if (p_ not_eq end_ and *p_ == ']')
+    {
+      ++p_;
+      return;
+    }
+    std::string element;
+    for (bool first = true; ; first = false)
+    {
+      skipSpace();
+      if (p_ not_eq end_ and (*p_ == '[' or *p_ == '{'))
+        fail("Array of key '" + t.prefix_ + key + "' holds objects or arrays,"
+             " which only indexed arrays can store");
+      scalar(element);
+      // such elements would be lost when the value is split again
+      if (element.empty() or element.find_first_of(" \t\n\r") not_eq std::string::npos)
+        fail("Array of key '" + t.prefix_ + key + "' holds an empty element or one"
+             " with whitespace, which only indexed arrays can store");
+      if (not first)
+        value_ += ' ';
+      value_ += element;
+      skipSpace();
+      if (p_ not_eq end_ and *p_ == ',')
+        ++p_;
+      else if (p_ not_eq end_ and *p_ == ']')
+      {
+        ++p_;
+        break;
+      }
+      else
+        fail("Expected ',' or ']'");
+    }
+  }
+
+  // read the string, number or literal at p_ into text
+  void scalar(std::string& text)
+  {
+    if (p_ == end_)
+      fail("Expected a value");
+    switch (*p_)
+    {
+    case '"':
+      quoted(text);
+      return;
+    case 't':
+      literal("true", text);
+      return;
+    case 'f':
+      literal("false", text);
+      return;
+    case 'n':
+      literal("null", text);
+      text.clear();
+      return;
+    default:
+      number(text);
+    }
+  }
+
+  void literal(const char* word, std::string& text)
+  {
+    const std::size_t length = std::strlen(word);
+    if (std::size_t(end_ - p_) < length or std::memcmp(p_, word, length) not_eq 0)
+      fail("Unexpected character");
+    text.assign(p_, length);
+    p_ += length;
+  }
+
+  // a number as in RFC 8259, kept as written
+  void number(std::string& text)
+  {
+    const char* start = p_;
+    if (p_ not_eq end_ and *p_ == '-')
+      ++p_;
+    if (p_ not_eq end_ and *p_ == '0')
+      ++p_;
+    else if (not digits())
+      fail("Unexpected character");
+    if (p_ not_eq end_ and *p_ == '.')
+    {
+      ++p_;
+      if (not digits())
+        fail("Expected digits after '.'");
+    }
+    if (p_ not_eq end_ and (*p_ == 'e' or *p_ == 'E'))
+    {
+      ++p_;
+      if (p_ not_eq end_ and (*p_ == '+' or *p_ == '-'))
+        ++p_;
+      if (not digits())
+        fail("Expected digits in exponent");
+    }
+    text.assign(start, p_);
+  }
+
+  // skip digits, false if there are none
+  bool digits()
+  {
+    const char* start = p_;
+    while (p_ not_eq end_ and *p_ >= '0' and *p_ <= '9')
+      ++p_;
+    return p_ not_eq start;
+  }
+
+  // read the string at p_, which starts with a quote, into text
+  void quoted(std::string& text)
+  {
+    ++p_;
+    text.clear();
+    for (;;)
+    {
+      // copy runs of plain characters at once
+      const char* run = p_;
+      while (p_ not_eq end_ and *p_ not_eq '"' and *p_ not_eq '\\'
+             and static_cast<unsigned char>(*p_) >= 0x20)
+        ++p_;
+      text.append(run, p_);
+      if (p_ == end_)
+        fail("Unterminated string");
+      if (*p_ == '"')
+      {
+        ++p_;
+        return;
+      }
+      if (*p_ not_eq '\\')
+        fail("Control character in string");
+      ++p_;
+      if (p_ == end_)
+        fail("Unterminated string");
+      switch (*p_++)
+      {
+      case '"':  text += '"'; break;
+      case '\\': text += '\\'; break;
+      case '/':  text += '/'; break;
+      case 'b':  text += '\b'; break;
+      case 'f':  text += '\f'; break;
+      case 'n':  text += '\n'; break;
+      case 'r':  text += '\r'; break;
+      case 't':  text += '\t'; break;
+      case 'u':  codePoint(text); break;
+      default:   fail("Invalid escape in string");
+      }
+    }
+  }
+
+  // append the character of a \u escape as UTF-8, p_ follows the 'u'
+  void codePoint(std::string& text)
+  {
+    unsigned long c = hex();
+    if (c >= 0xd800 and c < 0xdc00)
+    {
+      // the high half of a surrogate pair, the low half follows
+      if (end_ - p_ < 2 or p_[0] not_eq '\\' or p_[1] not_eq 'u')
+        fail("Unpaired surrogate in string");
+      p_ += 2;
+      const unsigned long low = hex();
+      if (low < 0xdc00 or low >= 0xe000)
+        fail("Unpaired surrogate in string");
+      c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+    }
+    else if (c >= 0xdc00 and c < 0xe000)
+      fail("Unpaired surrogate in string");
+    if (c < 0x80)
+      text += char(c);
+    else if (c < 0x800)
+    {
+      text += char(0xc0 | (c >> 6));
+      text += char(0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000)
+    {
+      text += char(0xe0 | (c >> 12));
+      text += char(0x80 | ((c >> 6) & 0x3f));
+      text += char(0x80 | (c & 0x3f));
+    }
+    else
+    {
+      text += char(0xf0 | (c >> 18));
+      text += char(0x80 | ((c >> 12) & 0x3f));
+      text += char(0x80 | ((c >> 6) & 0x3f));
+      text += char(0x80 | (c & 0x3f));
+    }
+  }
+
+  // four hexadecimal digits
+  unsigned long hex()
+  {
+    if (end_ - p_ < 4)
+      fail("Invalid escape in string");
+    unsigned long c = 0;
+    for (int i = 0; i < 4; ++i, ++p_)
+    {
+      c <<= 4;
+      if (*p_ >= '0' and *p_ <= '9')
+        c += *p_ - '0';
+      else if (*p_ >= 'a' and *p_ <= 'f')
+        c += *p_ - 'a' + 10;
+      else if (*p_ >= 'A' and *p_ <= 'F')
+        c += *p_ - 'A' + 10;
+      else
+        fail("Invalid escape in string");
+    }
+    return c;
+  }
+
+  // substructure key of t, which has no dots
+  ConfigTree& subtree(ConfigTree& t, const std::string& key)
+  {
+    if (not t.values_.empty() and t.values_.count(key) > 0)
+      fail("Key '" + t.prefix_ + key + "' occurs as value and as subtree");
+    return t.sub(key);
+  }
+
+  // store value_ as key of t, which has no dots
+  void store(ConfigTree& t, const std::string& key, std::size_t line)
+  {
+    if (not t.subs_.empty() and t.subs_.count(key) > 0)
+      fail("Key '" + t.prefix_ + key + "' occurs as value and as subtree", line);
+    t.touch();
+    ConfigTree::ValueMap::iterator it = t.values_.lower_bound(key);
+    if (it == t.values_.end() or it->first not_eq key)
+    {
+      t.valueKeys_.push_back(key);
+      it = t.values_.insert(it, std::make_pair(key, ConfigTree::Value()));
+    }
+    else
+    {
+      ConfigTree::Value* node = &it->second;
+      if (node->source == source_ or (not kept_.empty() and kept_.count(node)))
+        fail("Key '" + t.prefix_ + key + "' appears twice", line);
+      if (not overwrite_)
+      {
+        // the value keeps its source, but counts as read
+        kept_.insert(node);
+        return;
+      }
+    }
+    it->second.value = value_;
+    it->second.source = source_;
+    it->second.line = track_ ? line : 0;
+  }
+
+  // one level deeper into the document
+  void enter()
+  {
+    if (++depth_ > maxDepth)
+      fail("Objects and arrays nested too deeply");
+  }
+
+  void skipSpace()
+  {
+    for (; p_ not_eq end_; ++p_)
+      if (*p_ == '\n')
+        ++line_;
+      else if (*p_ not_eq ' ' and *p_ not_eq '\t' and *p_ not_eq '\r')
+        return;
+  }
+
+  void fail(const std::string& what) const
+  {
+    fail(what, line_);
+  }
+
+  void fail(const std::string& what, std::size_t line) const
+  {
+    std::ostringstream message;
+    message << what << " in " << srcname_ << ", line " << line << " !";
+    throw std::range_error(message.str());
+  }
+
+  const char* p_;
+  const char* end_;
+  std::size_t line_;
+  std::size_t depth_;
+  ArrayMode arrays_;
+  std::string srcname_;
+  bool overwrite_;
+  unsigned int source_;
+  bool track_;
+  // the scalar or joined array being stored
+  std::string value_;
+  // values kept instead of overwritten
+  std::set<const ConfigTree::Value*> kept_;
+};
+
+#endif // JSONPARSER_HH
@@ -0,0 +1,169 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef JSONWRITER_HH
+#define JSONWRITER_HH
+
+/** \file
+ * \brief Writer of ConfigTree objects as JSON documents
+ */
+
+#include <ostream>
+#include <string>
+
+#include "configtree.hh"
+#include "configtreewriter.hh"
+
+/** \brief Writer of ConfigTree objects as JSON documents
+ *
+ * The tree is written as an object with a member for every value and
+ * every substructure, the latter as nested objects. Values are written
+ * as strings, since the tree does not know their types.
+ * JSONParser::readJSONTree() reads the output back into the same tree.
+ *
+ * Output is collected in a buffer of bufferSize bytes and handed to the
+ * stream in one piece whenever it is full, so that a document is written
+ * while the tree is traversed.
+ */
+class JSONWriter : public ConfigTreeWriter
+{
+public:
+
+  /** \brief write pt as JSON to a stream */
+  static void write(const ConfigTree& pt, std::ostream& out, Order order = insertion)
+  {
+    std::string buffer;
+    buffer.reserve(bufferSize + bufferSize / 4);
+    JSONWriter writer(buffer, &out, order);
+    writer.document(pt);
+    writer.flush();
+  }
+
+  /** \brief write pt as JSON to the file with the given name
+   *
+   * \throw std::ofstream::failure if the file cannot be written
+   */
+  static void write(const ConfigTree& pt, const std::string& file, Order order = insertion)
+  {
+    writeFile<JSONWriter>(pt, file, order);
+  }
+
+  /** \brief pt as JSON */
+  static std::string str(const ConfigTree& pt, Order order = insertion)
+  {
+    std::string buffer;
+    JSONWriter writer(buffer, nullptr, order);
+    writer.document(pt);
+    return buffer;
+  }
+
+private:
+
+  // without out, buffer grows and takes the whole output
+  JSONWriter(std::string& buffer, std::ostream* out, Order order)
+    : ConfigTreeWriter(buffer, out, order)
+  {}
+
+  void document(const ConfigTree& pt)
+  {
+    object(pt);
+    buffer_ += '\n';
+  }
+
+  // write pt as an object, indented by indent_
+  void object(const ConfigTree& pt)
+  {
+    if (pt.values_.empty() and pt.subs_.empty())
+    {
+      buffer_ += "{}";
+      return;
+    }
+    buffer_ += '{';
+    indent_ += "  ";
+    bool first = true;
+    if (order_ == sorted)
+      for (ConfigTree::ValueMap::const_iterator it = pt.values_.begin();
+           it not_eq pt.values_.end(); ++it)
+        value(it->first, it->second.value, first);
+    else
+      for (std::size_t i = 0; i < pt.valueKeys_.size(); ++i)
+        value(pt.valueKeys_[i], pt.values_.find(pt.valueKeys_[i])->second.value, first);
+    if (order_ == sorted)
+      for (std::map<std::string, ConfigTree>::const_iterator it = pt.subs_.begin();
+           it not_eq pt.subs_.end(); ++it)
+        subtree(it->first, it->second, first);
+    else
+      for (std::size_t i = 0; i < pt.subKeys_.size(); ++i)
+        subtree(pt.subKeys_[i], pt.subs_.find(pt.subKeys_[i])->second, first);
+    indent_.resize(indent_.size() - 2);
+    buffer_ += '\n';
+    buffer_ += indent_;
+    buffer_ += '}';
+  }
+
+  void value(const std::string& key, const std::string& value, bool& first)
+  {
+    name(key, first);
+    string(value);
+    if (out_ and buffer_.size() >= bufferSize)
+      flush();
+  }
+
+  void subtree(const std::string& key, const ConfigTree& sub, bool& first)
+  {
+    name(key, first);
+    object(sub);
+  }
+
+  // start a member of the current object
+  void name(const std::string& key, bool& first)
+  {
+    if (not first)
+      buffer_ += ',';
+    first = false;
+    buffer_ += '\n';
+    buffer_ += indent_;
+    string(key);
+    buffer_ += ": ";
+  }
+
+  // s as a JSON string
+  void string(const std::string& s)
+  {
+    static const char hex[] = "0123456789abcdef";
+    buffer_ += '"';
+    const char* p = s.data();
+    const char* end = p + s.size();
+    while (p not_eq end)
+    {
+      // copy runs of characters without escapes at once
+      const char* run = p;
+      while (p not_eq end and *p not_eq '"' and *p not_eq '\\'
+             and static_cast<unsigned char>(*p) >= 0x20)
+        ++p;
+      buffer_.append(run, p);
+      if (p == end)
+        break;
+      const char c = *p++;
+      switch (c)
+      {
+      case '"':  buffer_ += "\\\""; break;
+      case '\\': buffer_ += "\\\\"; break;
+      case '\b': buffer_ += "\\b"; break;
+      case '\f': buffer_ += "\\f"; break;
+      case '\n': buffer_ += "\\n"; break;
+      case '\r': buffer_ += "\\r"; break;
+      case '\t': buffer_ += "\\t"; break;
+      default:
+        buffer_ += "\\u00";
+        buffer_ += hex[(c >> 4) & 0xf];
+        buffer_ += hex[c & 0xf];
+      }
+    }
+    buffer_ += '"';
+  }
+
+  // indentation of the members of the current object
+  std::string indent_;
+};
+
+#endif // JSONWRITER_HH
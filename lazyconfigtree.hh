@@ -0,0 +1,283 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef LAZYCONFIGTREE_HH
+#define LAZYCONFIGTREE_HH
+
+/** \file
+ * \brief ConfigTree read from an INI file on demand
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "configtree.hh"
+#include "configtreeparser.hh"
+#include "iniscanner.hh"
+#include "mappedfile.hh"
+#include "stringview.hh"
+
+/** \brief ConfigTree read from an INI file section by section on demand
+ *
+ * The constructor only scans the file for the byte ranges belonging to
+ * each top-level name, i.e. the first component of the keys: the
+ * `[section]` blocks and the runs of dotted keys outside of sections.
+ * The entries of a top-level name are parsed when a lookup first reaches
+ * it, so start-up time does not depend on the parts of a file that are
+ * never used.
+ *
+ * The result equals the one of ConfigTreeParser::readINITree(std::string,
+ * ConfigTree&, bool), including duplicate keys and the overwrite flag.
+ * Only the time differs: a duplicate key is reported when its top-level
+ * name is first loaded, and top-level keys are ordered by loading.
+ *
+ * Includes inside a section are loaded with their section. The keys of
+ * a file included outside of any section are not known in advance, so
+ * such an include makes the first lookup load the complete file. If that
+ * fails, the first lookup throws and later ones see the entries read
+ * before the error.
+ */
+class LazyConfigTree
+{
+public:
+
+  /** \brief index the file with the given name
+   *
+   * \param file      filename
+   * \param overwrite Whether to overwrite already existing values.
+   * \throw std::ifstream::failure if the file cannot be opened
+   */
+  explicit LazyConfigTree(const std::string& file, bool overwrite = true)
+    : filename_(file), file_(file), srcname_("file '" + file + "'"),
+      overwrite_(overwrite), eager_(false)
+  {
+    index();
+  }
+
+  /** \brief index the file with the given name, adding to pt
+   *
+   * \param file      filename
+   * \param pt        parameters present before the file is read
+   * \param overwrite Whether to overwrite values from pt.
+   * \throw std::ifstream::failure if the file cannot be opened
+   */
+  LazyConfigTree(const std::string& file, const ConfigTree& pt, bool overwrite = true)
+    : filename_(file), file_(file), srcname_("file '" + file + "'"),
+      overwrite_(overwrite), eager_(false), tree_(pt)
+  {
+    index();
+  }
+
+  /** \brief test for key, see ConfigTree::hasKey() */
+  bool hasKey(const std::string& key)
+  {
+    return load(key).hasKey(key);
+  }
+
+  /** \brief test for substructure, see ConfigTree::hasSub() */
+  bool hasSub(const std::string& key)
+  {
+    return load(key).hasSub(key);
+  }
+
+  /** \brief get substructure by name, see ConfigTree::sub() */
+  const ConfigTree& sub(const std::string& key, bool fail_if_missing = false)
+  {
+    return load(key).sub(key, fail_if_missing);
+  }
+
+  /** \brief get value as string, see ConfigTree::get() */
+  std::string get(const std::string& key, const std::string& defaultValue)
+  {
+    return load(key).get(key, defaultValue);
+  }
+
+  /** \brief get value as string, see ConfigTree::get() */
+  std::string get(const std::string& key, const char* defaultValue)
+  {
+    return load(key).get(key, defaultValue);
+  }
+
+  /** \brief get value converted to a certain type, see ConfigTree::get() */
+  template<typename T>
+  T get(const std::string& key, const T& defaultValue)
+  {
+    return load(key).template get<T>(key, defaultValue);
+  }
+
+  /** \brief get value converted to a certain type, see ConfigTree::get()
+   *
+   * \throw std::range_error if the key does not exist
+   */
+  template<typename T>
+  T get(const std::string& key)
+  {
+    return load(key).template get<T>(key);
+  }
+
+  /** \brief the complete tree, with all top-level names loaded */
+  const ConfigTree& tree()
+  {
+    if (eager_)
+      return loadAll();
+    for (std::size_t i = 0; i < order_.size(); ++i)
+      load(groups_.find(order_[i])->second);
+    for (Groups::iterator it = groups_.begin(); it not_eq groups_.end(); ++it)
+      load(it->second);
+    return tree_;
+  }
+
+  /** \brief number of top-level names in the file */
+  std::size_t sections() const
+  {
+    return groups_.size();
+  }
+
+  /** \brief number of top-level names loaded so far */
+  std::size_t loadedSections() const
+  {
+    std::size_t loaded = 0;
+    for (Groups::const_iterator it = groups_.begin(); it not_eq groups_.end(); ++it)
+      loaded += it->second.loaded;
+    return loaded;
+  }
+
+private:
+
+  // a range of lines of the file, starting with no section or with a
+  // section header
+  struct Run
+  {
+    std::size_t begin;
+    std::size_t end;
+    std::size_t line;
+  };
+
+  // the runs holding the entries of one top-level name
+  struct Group
+  {
+    Group() : ordered(false), loaded(false) {}
+    std::vector<Run> runs;
+    bool ordered;
+    bool loaded;
+  };
+
+  typedef std::map<std::string, Group> Groups;
+
+  // first component of a key
+  static StringView topName(StringView key)
+  {
+    std::size_t dot = key.find('.');
+    return dot == std::string::npos ? key : key.substr(0, dot);
+  }
+
+  // record the runs of lines of each top-level name
+  void index()
+  {
+    const char* data = file_.data();
+    INIScanner scanner(data, data + file_.size());
+    INIScanner::Token token;
+    StringView section;
+    bool inSection = false;
+    StringView current;
+    Group* group = nullptr;
+    while (scanner.next(token))
+    {
+      StringView top;
+      if (token.kind == INIScanner::Token::section)
+      {
+        // after [] every key is grouped by its own first component
+        inSection = not token.key.empty();
+        if (not inSection)
+          continue;
+        section = top = topName(token.key);
+      }
+      else if (inSection)
+        top = section;
+      else if (token.kind == INIScanner::Token::include or token.key == "include")
+      {
+        eager_ = true;
+        continue;
+      }
+      else
+        top = topName(token.key);
+
+      if (not group or top not_eq current)
+      {
+        const char* start = token.key.data();
+        while (start not_eq data and start[-1] not_eq '\n')
+          --start;
+        if (group)
+          group->runs.back().end = start - data;
+        group = &groups_[top.str()];
+        Run run = {std::size_t(start - data), file_.size(), token.line};
+        group->runs.push_back(run);
+        current = top;
+      }
+      // the tree creates top-level keys at their first entry
+      if (token.kind not_eq INIScanner::Token::section and not group->ordered)
+      {
+        group->ordered = true;
+        order_.push_back(top.str());
+      }
+    }
+  }
+
+  // the tree, after loading the top-level name of key
+  const ConfigTree& load(const std::string& key)
+  {
+    if (eager_)
+      return loadAll();
+    Groups::iterator it = groups_.find(topName(StringView(key.data(), key.size())).str());
+    if (it not_eq groups_.end())
+      load(it->second);
+    return tree_;
+  }
+
+  // the whole file at once, in the order of the file. A failed parse is
+  // not repeated, the tree keeps the entries read before the error.
+  const ConfigTree& loadAll()
+  {
+    eager_ = false;
+    for (Groups::iterator it = groups_.begin(); it not_eq groups_.end(); ++it)
+      it->second.loaded = true;
+    ConfigTreeParser::readINIBuffer(file_.data(), file_.size(), tree_, srcname_,
+                                    overwrite_, filename_, &fragments_);
+    return tree_;
+  }
+
+  void load(Group& group)
+  {
+    if (group.loaded)
+      return;
+    // one builder for all runs, so that duplicates between them are found
+    ConfigTreeParser::INIBuilder builder(tree_, srcname_, overwrite_, filename_, &fragments_);
+    INIScanner::Token root;
+    root.kind = INIScanner::Token::section;
+    for (std::size_t i = 0; i < group.runs.size(); ++i)
+    {
+      const Run& run = group.runs[i];
+      const char* begin = file_.data() + run.begin;
+      const char* end = file_.data() + run.end;
+      builder.apply(root);
+      INIScanner scanner(begin, end, end, run.line);
+      builder.read(scanner);
+    }
+    group.loaded = true;
+  }
+
+  std::string filename_;
+  MappedFile file_;
+  std::string srcname_;
+  bool overwrite_;
+  // whether the file has includes outside of sections and is not
+  // loaded yet
+  bool eager_;
+  ConfigTreeParser::FragmentCache fragments_;
+  ConfigTree tree_;
+  Groups groups_;
+  // top-level names in order of their first entry
+  std::vector<std::string> order_;
+};
+
+#endif // LAZYCONFIGTREE_HH
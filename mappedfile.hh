@@ -0,0 +1,152 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef MAPPEDFILE_HH
+#define MAPPEDFILE_HH
+
+/** \file
+ * \brief Read-only view of the contents of a file
+ */
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#if HAVE_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // HAVE_MMAP
+
+/** \brief Read-only view of the contents of a file
+ *
+ * The file is mapped into memory if the platform supports mmap,
+ * otherwise its contents are read into a buffer, as are those of pipes
+ * and devices like /dev/stdin. Either way data()
+ * points to size() contiguous bytes which stay valid for the lifetime
+ * of the object.
+ */
+class MappedFile
+{
+public:
+
+  /** \brief map the file with the given name
+   *
+   * \param file filename
+   * \throw std::ifstream::failure if the file cannot be opened or mapped
+   */
+  explicit MappedFile(const std::string& file)
+    : data_(nullptr), size_(0), mapped_(false)
+  {
+    errno = 0;
+#if HAVE_MMAP
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+      fail(file);
+    struct stat st;
+    if (::fstat(fd, &st) not_eq 0)
+    {
+      ::close(fd);
+      fail(file);
+    }
+    if (not S_ISREG(st.st_mode))
+    {
+      // pipes and devices have no size to map, read them to the end
+      readAll(fd, file);
+      ::close(fd);
+      data_ = buffer_.data();
+      return;
+    }
+    size_ = st.st_size;
+    if (size_ > 0)
+    {
+      void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED)
+      {
+        ::close(fd);
+        fail(file);
+      }
+      ::madvise(addr, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(addr);
+      mapped_ = true;
+    }
+    ::close(fd);
+#else
+    std::ifstream in(file.c_str(), std::ios::in | std::ios::binary);
+    if (not in)
+      fail(file);
+    std::ostringstream contents;
+    contents << in.rdbuf();
+    buffer_ = contents.str();
+    size_ = buffer_.size();
+#endif // HAVE_MMAP
+    if (not mapped_)
+      data_ = buffer_.data();
+  }
+
+  ~MappedFile()
+  {
+#if HAVE_MMAP
+    if (mapped_)
+      ::munmap(const_cast<char*>(data_), size_);
+#endif // HAVE_MMAP
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /** \brief first byte of the file contents */
+  const char* data() const
+  {
+    return data_;
+  }
+
+  /** \brief number of bytes in the file */
+  std::size_t size() const
+  {
+    return size_;
+  }
+
+private:
+
+#if HAVE_MMAP
+  // read fd up to its end into buffer_
+  void readAll(int fd, const std::string& file)
+  {
+    char chunk[1 << 16];
+    for (;;)
+    {
+      const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+      if (n == 0)
+        break;
+      if (n < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        ::close(fd);
+        fail(file);
+      }
+      buffer_.append(chunk, n);
+    }
+    size_ = buffer_.size();
+  }
+#endif // HAVE_MMAP
+
+  static void fail(const std::string& file)
+  {
+    std::ostringstream message;
+    message << "Could not open configuration file " << file;
+    if (errno not_eq 0)
+      message << " (" << std::strerror(errno) << ")";
+    throw std::ifstream::failure(message.str());
+  }
+
+  const char* data_;
+  std::size_t size_;
+  bool mapped_;
+  std::string buffer_;
+};
+
+#endif
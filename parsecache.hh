@@ -0,0 +1,153 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef PARSECACHE_HH
+#define PARSECACHE_HH
+
+/** \file
+ * \brief On-disk cache of parsed configuration files
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "binaryconfigtree.hh"
+#include "configtree.hh"
+
+/** \brief Directory of parsed configuration files
+ *
+ * Stores the tree parsed from a file in the binary format of
+ * BinaryConfigTree, under a name derived from a 128 bit hash and the
+ * size of the file contents and from the parser version. Unchanged files
+ * are then loaded without tokenizing them again, whatever their name.
+ *
+ * Several processes may share a directory: entries are written to a
+ * temporary file and renamed into place, so readers see complete entries
+ * only, and damaged entries fail their checksum and count as misses.
+ * Entries are never modified, they may be deleted at any time.
+ *
+ * The directory has to exist. If it is not writable the cache only
+ * counts misses.
+ */
+class ParseCache
+{
+public:
+
+  /** \brief version of the parse result
+   *
+   * Part of every entry name; increase it whenever a change of the
+   * parser changes the tree read from some input, so that old entries
+   * are no longer used.
+   */
+  static const unsigned int parserVersion = 1;
+
+  /** \brief cache in the given directory */
+  explicit ParseCache(const std::string& directory)
+    : directory_(directory), hits_(0), misses_(0), failedWrites_(0)
+  {
+    if (not directory_.empty() and directory_[directory_.size()-1] not_eq '/')
+      directory_ += '/';
+  }
+
+  ParseCache(const ParseCache&) = delete;
+  ParseCache& operator=(const ParseCache&) = delete;
+
+  /** \brief name of the entry for input with the given contents */
+  std::string entry(const char* data, std::size_t size) const
+  {
+    std::ostringstream name;
+    name << directory_ << std::hex << std::setfill('0')
+         << std::setw(16) << BinaryConfigTree::checksum(data, size, 1)
+         << std::setw(16) << BinaryConfigTree::checksum(data, size, 2)
+         << std::dec << "-" << size
+         << ".p" << parserVersion << ".b" << BinaryConfigTree::version << ".ctb";
+    return name.str();
+  }
+
+  /** \brief add the cached tree of the given contents to pt
+   *
+   * \return false if the cache holds no valid entry for the contents
+   */
+  bool load(const char* data, std::size_t size, ConfigTree& pt, bool overwrite)
+  {
+    ConfigTree cached;
+    try
+    {
+      cached = BinaryConfigTree(entry(data, size)).tree();
+    }
+    catch (const std::exception&)
+    {
+      ++misses_;
+      return false;
+    }
+    ++hits_;
+    pt.merge(std::move(cached), overwrite);
+    return true;
+  }
+
+  /** \brief store the tree parsed from the given contents */
+  void store(const char* data, std::size_t size, const ConfigTree& pt)
+  {
+    const std::string name = entry(data, size);
+    std::ostringstream temporary;
+    temporary << name << ".tmp" << uniqueId();
+    try
+    {
+      BinaryConfigTree::write(pt, temporary.str());
+      if (std::rename(temporary.str().c_str(), name.c_str()) == 0)
+        return;
+    }
+    catch (const std::exception&)
+    {}
+    std::remove(temporary.str().c_str());
+    ++failedWrites_;
+  }
+
+  /** \brief number of inputs found in the cache */
+  std::size_t hits() const
+  {
+    return hits_;
+  }
+
+  /** \brief number of inputs not found in the cache */
+  std::size_t misses() const
+  {
+    return misses_;
+  }
+
+  /** \brief number of entries that could not be written */
+  std::size_t failedWrites() const
+  {
+    return failedWrites_;
+  }
+
+  /** \brief fraction of the inputs found in the cache */
+  double hitRate() const
+  {
+    std::size_t total = hits_ + misses_;
+    return total ? double(hits_) / total : 0.0;
+  }
+
+private:
+
+  // random suffix of a temporary file, drawn per file as processes
+  // forked from one parent share their state
+  static std::string uniqueId()
+  {
+    std::random_device random;
+    std::ostringstream id;
+    id << std::hex << random() << random();
+    return id.str();
+  }
+
+  std::string directory_;
+  std::atomic<std::size_t> hits_;
+  std::atomic<std::size_t> misses_;
+  std::atomic<std::size_t> failedWrites_;
+};
+
+#endif // PARSECACHE_HH
@@ -0,0 +1,156 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef PARSESTATS_HH
+#define PARSESTATS_HH
+
+/** \file
+ * \brief Counts and timings of a parse
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <ostream>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+/** \brief Counts and timings of a parse
+ *
+ * Filled by the parsers of ConfigTreeParser that take a ParseStats.
+ * Several parses with the same object add up.
+ *
+ * The wall time of a parse is split into phases: reading the input,
+ * tokenizing it, inserting entries into the tree and checking them for
+ * duplicates. Files are memory mapped where supported; their pages are
+ * touched while reading, so that tokenizing does not wait for the disk.
+ * Taking the time of every entry costs a few clock reads per entry, so
+ * a measured parse is somewhat slower than one without statistics.
+ */
+struct ParseStats
+{
+  typedef std::chrono::steady_clock Clock;
+  typedef std::chrono::nanoseconds Duration;
+
+  ParseStats()
+    : bytes(0), lines(0), sections(0), keys(0), multilineValues(0), includes(0),
+      allocatedBytes(0), readTime(0), scanTime(0), insertTime(0), checkTime(0),
+      totalTime(0), open_(false), heap_(0)
+  {}
+
+  //! bytes of input read, including included files
+  std::size_t bytes;
+  //! lines of INI input read, including included files
+  std::size_t lines;
+  //! section headers read
+  std::size_t sections;
+  //! entries read, whether stored or not
+  std::size_t keys;
+  //! values spanning several lines
+  std::size_t multilineValues;
+  //! include directives read
+  std::size_t includes;
+  //! growth of the heap during the parse, 0 where unknown; counts the
+  //! allocations of all threads of the process
+  std::size_t allocatedBytes;
+
+  //! reading files and streams
+  Duration readTime;
+  //! splitting the input into entries
+  Duration scanTime;
+  //! storing entries in the tree
+  Duration insertTime;
+  //! checking entries for duplicates
+  Duration checkTime;
+  //! the complete parse
+  Duration totalTime;
+
+  /** \brief print the counts and timings to a stream */
+  void report(std::ostream& stream) const
+  {
+    stream << "bytes " << bytes << ", lines " << lines << ", sections " << sections
+           << ", keys " << keys << ", multiline values " << multilineValues
+           << ", includes " << includes << ", allocated bytes " << allocatedBytes << "\n";
+    const std::streamsize precision = stream.precision(3);
+    const std::ios::fmtflags flags = stream.setf(std::ios::fixed, std::ios::floatfield);
+    stream << "read " << milliseconds(readTime) << " ms, scan " << milliseconds(scanTime)
+           << " ms, insert " << milliseconds(insertTime)
+           << " ms, check " << milliseconds(checkTime)
+           << " ms, total " << milliseconds(totalTime) << " ms\n";
+    stream.precision(precision);
+    stream.flags(flags);
+  }
+
+  /** \brief bytes allocated on the heap by the process, 0 where unknown */
+  static std::size_t heapInUse()
+  {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    return mallinfo2().uordblks;
+#else
+    return 0;
+#endif
+  }
+
+private:
+  friend class ConfigTreeParser;
+
+  static double milliseconds(Duration d)
+  {
+    return std::chrono::duration<double, std::milli>(d).count();
+  }
+
+  // begin a parse
+  void start()
+  {
+    start_ = mark_ = Clock::now();
+    heap_ = heapInUse();
+  }
+
+  // add the time since the last lap to the given phase
+  void lap(Duration ParseStats::* phase)
+  {
+    const Clock::time_point now = Clock::now();
+    this->*phase += now - mark_;
+    mark_ = now;
+  }
+
+  // count the lines and bytes of a complete input
+  void input(const char* data, std::size_t size)
+  {
+    bytes += size;
+    lines += std::count(data, data + size, '\n');
+    if (size > 0 and data[size - 1] not_eq '\n')
+      ++lines;
+  }
+
+  // count the lines and bytes of the next piece of a stream
+  void piece(const char* data, std::size_t size)
+  {
+    if (size == 0)
+      return;
+    bytes += size;
+    lines += std::count(data, data + size, '\n');
+    open_ = (data[size - 1] not_eq '\n');
+  }
+
+  // end a parse, the last piece of a stream may end within a line
+  void stop()
+  {
+    lines += open_;
+    open_ = false;
+    totalTime += Clock::now() - start_;
+    const std::size_t heap = heapInUse();
+    if (heap > heap_)
+      allocatedBytes += heap - heap_;
+  }
+
+  Clock::time_point start_;
+  Clock::time_point mark_;
+  // whether the last piece of a stream ended within a line
+  bool open_;
+  // heap in use at the start of the parse
+  std::size_t heap_;
+};
+
+#endif // PARSESTATS_HH
@@ -0,0 +1,117 @@
+// -*- tab-width: 2; indent-tabs-mode: nil -*-
+// vi: set et ts=2 sw=2 sts=2:
+#ifndef STRINGVIEW_HH
+#define STRINGVIEW_HH
+
+/** \file
+ * \brief A non-owning reference to a range of characters
+ */
+
+#include <cstring>
+#include <ostream>
+#include <string>
+
+/** \brief Non-owning reference to a contiguous range of characters
+ *
+ * A minimal stand-in for C++17's std::string_view, used by the parsers
+ * to hand out tokens without copying them out of the input buffer.
+ * The referenced characters must outlive the view.
+ */
+class StringView
+{
+public:
+
+  typedef const char* const_iterator;
+
+  StringView()
+    : data_(nullptr), size_(0)
+  {}
+
+  StringView(const char* data, std::size_t size)
+    : data_(data), size_(size)
+  {}
+
+  StringView(const char* begin, const char* end)
+    : data_(begin), size_(end - begin)
+  {}
+
+  StringView(const char* str)
+    : data_(str), size_(std::strlen(str))
+  {}
+
+  StringView(const std::string& str)
+    : data_(str.data()), size_(str.size())
+  {}
+
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const_iterator begin() const { return data_; }
+  const_iterator end() const { return data_ + size_; }
+
+  char operator[] (std::size_t i) const { return data_[i]; }
+  char front() const { return data_[0]; }
+  char back() const { return data_[size_-1]; }
+
+  /** \brief copy the referenced characters into a std::string */
+  std::string str() const
+  {
+    return std::string(data_, size_);
+  }
+
+  /** \brief view of at most count characters starting at pos */
+  StringView substr(std::size_t pos, std::size_t count = std::string::npos) const
+  {
+    if (pos > size_)
+      pos = size_;
+    if (count > size_ - pos)
+      count = size_ - pos;
+    return StringView(data_ + pos, count);
+  }
+
+  /** \brief position of the first occurrence of c at or after pos, or npos */
+  std::size_t find(char c, std::size_t pos = 0) const
+  {
+    if (pos >= size_)
+      return std::string::npos;
+    const void* hit = std::memchr(data_ + pos, c, size_ - pos);
+    return hit ? static_cast<const char*>(hit) - data_ : std::string::npos;
+  }
+
+  int compare(const StringView& other) const
+  {
+    std::size_t n = (size_ < other.size_) ? size_ : other.size_;
+    int result = (n > 0) ? std::memcmp(data_, other.data_, n) : 0;
+    if (result not_eq 0)
+      return result;
+    return (size_ < other.size_) ? -1 : (size_ > other.size_);
+  }
+
+  friend bool operator== (const StringView& a, const StringView& b)
+  {
+    return a.size_ == b.size_
+      and (a.size_ == 0 or std::memcmp(a.data_, b.data_, a.size_) == 0);
+  }
+
+  friend bool operator not_eq (const StringView& a, const StringView& b)
+  {
+    return not (a == b);
+  }
+
+  friend bool operator< (const StringView& a, const StringView& b)
+  {
+    return a.compare(b) < 0;
+  }
+
+  friend std::ostream& operator<< (std::ostream& stream, const StringView& s)
+  {
+    return stream.write(s.data_, s.size_);
+  }
+
+private:
+  const char* data_;
+  std::size_t size_;
+};
+
+#endif